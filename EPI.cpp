@@ -2,6 +2,13 @@
 
 /* Chapter 5 Primary Type */
 
+/*
+The routines below are the textbook versions. Batch kernels for
+parity, bit reversal and the 5.9 palindrome check, and the word
+kernels behind BitVector, are compiled per ISA in kernels.inc and
+picked at startup, see dispatch.h.
+*/
+
 /******* 5.1 Parity Problem *******/
 
 /* The odd number of set bit returns 1, else return 0 */
@@ -54,8 +61,7 @@ int parityDivAndConq(unsigned long long num) {
 	int shift = 32;
 	do {
 		/*Show binary form of 'num'*/
-		std::string binary = std::bitset<64>(num).to_string();
-		std::cout << binary << std::endl;
+		/*std::cout << std::bitset<64>(num) << std::endl;*/
 
 		num ^= (num >> shift);
 
@@ -221,6 +227,13 @@ int revIntImprove(int n) {
 	return negative ? -ans : ans;
 }
 
+/*
+Both versions above overflow: numPos * 10 wraps for n above about
+2^31 / 10, and ans * 10 wraps silently, -INT_MIN as well.
+reverse_digits<T>() in EPI.h fixes that and avoids the div,
+bench.cpp compares the three.
+*/
+
 /******* 5.3 Reverse bits Problem *******/
 
 /*
@@ -230,7 +243,7 @@ Brute force through the way in 5.2
 unsigned long revBits(unsigned long num) {
 
 	int len = (sizeof num) * 4;
-	std::cout << len << std::endl;
+	/*std::cout << len << std::endl;*/
 
 	for (int i = 0; i < len / 2; i++) {
 		if (((num >> i) & 0x1) != ((num >> (len - i - 1)) & 0x1)) {
@@ -285,19 +298,20 @@ There is a better way.
 When check failed, stop running immediately.
 
 Note: the length of most significant digit would
-be given by floor(log10(X)) + 1.
+be given by floor(log10(X)) + 1, digitCount() in EPI.h gets
+it with integer ops only. The mask has to be a long as well,
+an int mask overflows past 10 digits.
 */
 
 int checkPalindromeImprove(long num) {
 
 	if (num < 0) return 0;
 
-	int maskLength = floor(log10(num)) + 1;
-	int numMask = pow(10, maskLength - 1);
+	long numMask = kPow10[digitCount(num) - 1];
 
 	while (num) {
-		int tail = num % 10;
-		int head =  num / numMask;
+		long tail = num % 10;
+		long head =  num / numMask;
 
 		if (tail != head) return 0;
 
@@ -311,6 +325,36 @@ int checkPalindromeImprove(long num) {
 
 }
 
+/*
+One unsigned id: write the digits out once with the two-digit
+table, then compare both ends. Random ids mostly fail on the first
+and last digit, so that pair is checked, with an early exit, before
+writing anything.
+
+For large streams checkPalindromeBatch goes to the dispatched kernel
+(kernels.inc), which splits the digits with SSE4.1 where the CPU has
+it and checks every id the same branch-free way.
+*/
+
+int checkPalindromeDigits(uint64_t num) {
+
+	int len = digitCount(num);
+	if (num / kPow10[len - 1] != num - div10(num) * 10) return 0;
+
+	char buf[20];
+	writeDigits(num, buf);
+
+	int mismatch = 0;
+	for (int i = 0; i < len / 2; ++i) {
+		mismatch |= buf[i] ^ buf[len - 1 - i];
+	}
+	return mismatch == 0;
+}
+
+void checkPalindromeBatch(const uint64_t *nums, size_t n, unsigned char *res) {
+	dispatch::active.palindromeBatch(nums, n, res);
+}
+
 /******* 5.11 Rectangle Intersection Problem *******/
 
 /*
@@ -559,6 +603,8 @@ use loop two pinters
 
 void rearrange (std::vector<int> & v, int idx) {
 
+	EPI_PROBE("rearrange");
+
 	int smaller = 0, unclassified = 0, larger = v.size() - 1;
 	int pivot = v[idx];
 
@@ -595,7 +641,9 @@ void incre_arb_int(std::vector<int> & v) {
 
 		} else if (it == v.rend() - 1) {
 			*it = 0;
+			// insert invalidates 'it', so stop here
 			v.insert(v.begin(), 1);
+			break;
 		} else {
 			*it = 0;
 		}
@@ -616,6 +664,8 @@ void incre_arb_int(std::vector<int> & v) {
 
 std::deque<int> mult_arb_int (std::vector<int> v1, std::vector<int> v2) {
 
+	EPI_PROBE("mult_arb_int");
+
 	std::deque<int> res(v1.size() + v2.size(), 0);
 
 	int sign = v1[0] * v2[0] < 0 ? -1 : 1; // negative
@@ -642,6 +692,13 @@ std::deque<int> mult_arb_int (std::vector<int> v1, std::vector<int> v2) {
 	return res;
 }
 
+/*
+One decimal digit per int is quadratic from end to end. For numbers
+of thousands of digits and more, BigInt (bigint.h) keeps 32-bit limbs,
+multiplies with Karatsuba and converts to and from decimal text by
+divide and conquer.
+*/
+
 /******* 6.4 Advancing through an array *******/
 
 /*
@@ -758,6 +815,10 @@ Sieve of Eratosthenes:
 
 std::vector<int> primer_array(int N) {
 
+	EPI_PROBE("primer_array");
+
+	if (N < 2) return std::vector<int>();
+
 	std::vector<short> v(N + 1, 1);
 	v[0] = 0;
 	v[1] = 0;
@@ -777,6 +838,229 @@ std::vector<int> primer_array(int N) {
 	return res;
 }
 
+/*
+The same sieve as a BitVector (bitvector.h), one bit per number
+instead of a short, with bit i set for every prime i < N. The
+rank/select index answers
+
+	rank1(x)   -> number of primes below x
+	select1(k) -> the k-th prime, counting from 0
+
+without keeping the list of primes. The sieve crosses off bits in
+the words the BitVector then takes over, so N / 8 bytes is all the
+memory it needs.
+*/
+
+BitVector primer_bitvector(int N) {
+
+	size_t n = N > 0 ? N : 0, numWords = (n + 63) / 64;
+	std::vector<uint64_t> words((numWords / 8 + 1) * 8, ~0ULL);
+	words[0] &= ~3ULL;
+
+	for (size_t i = 2; i * i < n; ++i) {
+		if (words[i >> 6] >> (i & 63) & 1) {
+			for (size_t j = i * i; j < n; j += i) words[j >> 6] &= ~(1ULL << (j & 63));
+		}
+	}
+	return BitVector(std::move(words), n);
+}
+
+/*
+Beyond the sieve: testing a single 64-bit number.
+
+Sieving to 2^64 is out of the question, but Miller-Rabin with the
+seven bases below (Sinclair, 2011) has no 64-bit pseudoprime, so the
+answer is exact and Baillie-PSW is not needed. The modular power is
+expoLoop's square-and-multiply, done in Montgomery form so each
+product is two multiplies and a subtract instead of a 128-bit '%'.
+*/
+
+static const uint64_t kMillerRabinBases[7] = {2, 325, 9375, 28178, 450775, 9780504, 1795265022};
+
+// Odd modulus n in Montgomery form, R = 2^64
+struct Montgomery {
+	uint64_t n, ninv, r2, one, minusOne;
+
+	explicit Montgomery(uint64_t n) : n(n) {
+		// Newton: each step doubles the correct low bits of n^-1 mod 2^64
+		ninv = n;
+		for (int i = 0; i < 5; ++i) ninv *= 2 - n * ninv;
+		one = (0 - n) % n;                                  // R mod n
+		r2 = static_cast<uint64_t>(static_cast<uint128_t>(one) * one % n);
+		minusOne = n - one;
+	}
+
+	// a * b / R mod n: the low halves of a * b and m * n cancel
+	uint64_t mul(uint64_t a, uint64_t b) const {
+		uint128_t t = static_cast<uint128_t>(a) * b;
+		uint64_t m = static_cast<uint64_t>(t) * ninv;
+		uint64_t hi = t >> 64, mn = (static_cast<uint128_t>(m) * n) >> 64;
+		return hi >= mn ? hi - mn : hi - mn + n;
+	}
+
+	uint64_t to(uint64_t a) const { return mul(a % n, r2); }
+};
+
+/*
+Trial division by the primes below 64 with no division: for odd p,
+p | n exactly when n * p^-1 mod 2^64 <= (2^64 - 1) / p.
+*/
+struct SmallPrime {
+	uint64_t p, inv, limit;
+};
+
+static std::vector<SmallPrime> buildSmallPrimes() {
+	const int primes[] = {3, 5, 7, 11, 13, 17, 19, 23, 29, 31, 37, 41, 43, 47, 53, 59, 61};
+	std::vector<SmallPrime> table;
+	for (int p : primes) {
+		SmallPrime s = {static_cast<uint64_t>(p), Montgomery(p).ninv, ~0ULL / p};
+		table.push_back(s);
+	}
+	return table;
+}
+
+static const std::vector<SmallPrime> &smallPrimes() {
+	static const std::vector<SmallPrime> table = buildSmallPrimes();
+	return table;
+}
+
+/* 1 = prime, 0 = composite, -1 = needs Miller-Rabin */
+static int trialDivision(uint64_t n) {
+
+	if (n < 2) return 0;
+	if (!(n & 1)) return n == 2;
+
+	const std::vector<SmallPrime> &primes = smallPrimes();
+	for (size_t i = 0; i < primes.size(); ++i) {
+		if (n * primes[i].inv <= primes[i].limit) return n == primes[i].p;
+	}
+	return n < 67 * 67 ? 1 : -1;
+}
+
+/* One Miller-Rabin round, n - 1 = d * 2^s, a already in Montgomery form */
+static bool millerRabinRound(const Montgomery &m, uint64_t a, uint64_t d, int s) {
+
+	// expoLoop, with mul() for '*'
+	uint64_t ans = m.one;
+	while (d) {
+		if (d & 1) ans = m.mul(ans, a);
+		a = m.mul(a, a);
+		d >>= 1;
+	}
+
+	if (ans == m.one || ans == m.minusOne) return true;
+	for (int i = 1; i < s; ++i) {
+		ans = m.mul(ans, ans);
+		if (ans == m.minusOne) return true;
+	}
+	return false;
+}
+
+bool is_prime_u64(uint64_t n) {
+
+	int small = trialDivision(n);
+	if (small >= 0) return small;
+
+	Montgomery m(n);
+	int s = __builtin_ctzll(n - 1);
+	uint64_t d = (n - 1) >> s;
+
+	for (int i = 0; i < 7; ++i) {
+		uint64_t a = kMillerRabinBases[i] % n;
+		if (a && !millerRabinRound(m, m.to(a), d, s)) return false;
+	}
+	return true;
+}
+
+/*
+Batch version. A single test is one long chain of dependent
+multiplies, so the core mostly waits on multiply latency. Here four
+candidates run in lanes, and the power loop steps all four at once,
+giving the core four independent chains to overlap. A lane that
+passes a base moves on to the next base. A lane that fails or passes
+all seven takes the next candidate that survives trial division.
+*/
+
+void is_prime_batch(const uint64_t *nums, size_t n, unsigned char *res) {
+
+	const int L = 4;
+
+	struct Lane {
+		size_t idx;
+		int base, s;
+		uint64_t d;
+		Montgomery m;
+		Lane() : idx(0), base(-1), s(0), d(0), m(3) {}
+	} lanes[L];
+
+	size_t next = 0;
+
+	// Fill a free lane with the next candidate that needs Miller-Rabin
+	auto refill = [&](Lane &lane) {
+		lane.base = -1;
+		while (next < n) {
+			size_t i = next++;
+			int small = trialDivision(nums[i]);
+			if (small >= 0) {
+				res[i] = small;
+				continue;
+			}
+			lane.idx = i;
+			lane.base = 0;
+			lane.m = Montgomery(nums[i]);
+			lane.s = __builtin_ctzll(nums[i] - 1);
+			lane.d = (nums[i] - 1) >> lane.s;
+			return;
+		}
+	};
+
+	for (int l = 0; l < L; ++l) refill(lanes[l]);
+
+	while (true) {
+
+		bool active = false;
+		uint64_t a[L], ans[L];
+		int bits = 0;
+		for (int l = 0; l < L; ++l) {
+			if (lanes[l].base < 0) {
+				a[l] = ans[l] = lanes[l].m.one;
+				continue;
+			}
+			active = true;
+			uint64_t base = kMillerRabinBases[lanes[l].base] % lanes[l].m.n;
+			// A base that is 0 mod n proves nothing, let it pass
+			a[l] = base ? lanes[l].m.to(base) : lanes[l].m.one;
+			ans[l] = lanes[l].m.one;
+			bits = std::max(bits, 64 - __builtin_clzll(lanes[l].d));
+		}
+		if (!active) break;
+
+		// Interleaved expoLoop, a multiply is always done and kept or not
+		for (int b = 0; b < bits; ++b) {
+			for (int l = 0; l < L; ++l) {
+				uint64_t t = lanes[l].m.mul(ans[l], a[l]);
+				ans[l] = (lanes[l].d >> b) & 1 ? t : ans[l];
+				a[l] = lanes[l].m.mul(a[l], a[l]);
+			}
+		}
+
+		for (int l = 0; l < L; ++l) {
+			Lane &lane = lanes[l];
+			if (lane.base < 0) continue;
+
+			bool pass = ans[l] == lane.m.one || ans[l] == lane.m.minusOne;
+			for (int i = 1; i < lane.s && !pass; ++i) {
+				ans[l] = lane.m.mul(ans[l], ans[l]);
+				pass = ans[l] == lane.m.minusOne;
+			}
+
+			if (pass && ++lane.base < 7) continue;
+			res[lane.idx] = pass;
+			refill(lane);
+		}
+	}
+}
+
 /******* 6.9 Permute the elements of an array*******/
 
 /*
@@ -828,7 +1112,9 @@ std::vector<char> permute_impv(std::vector<char> &v, std::vector<int> &p) {
 	}
 
 	//	restore the permutation list
-	std::for_each(p.begin(), p.end(), [&, p](int x) {x += p.size();});
+	//	(by reference, a by-value capture would restore a copy)
+	int size = p.size();
+	std::for_each(p.begin(), p.end(), [size](int &x) {x += size;});
 	return v;
 }
 /* 	C++11 Lambda
@@ -878,6 +1164,12 @@ std::vector<int> next_permt(std::vector<int> &v) {
 	return v;
 }
 
+/*
+Combinations and subsets go the same way without a vector at all:
+combinations.h keeps one as the bits of a word and steps with
+Gosper's hack or a revolving-door Gray code.
+*/
+
 
 /******* 6.11 Sample Offline Data*******/
 
@@ -916,27 +1208,851 @@ std::vector<int> random_subset(std::vector<int> &v, int k) {
 
 
 
-int main() {
+/******* Allocator-aware versions (arena.h) *******/
 
-	int array1[] = {1, 0, 3, 2};
-	int array2[] = {6, 2, 1, 5, 4, 3, 0};
+/*
+6.3, 6.7, 6.8 and 6.9 with every container they build taken from a
+MemoryResource, e.g. a MonotonicArena reset between requests or the
+thread's SizeClassPool, instead of the global heap. Same results as
+the versions above.
+*/
 
-	std::vector<int> v1(array1, array1 + 4);
-	std::vector<int> v2(array2, array2 + 7);
+ResourceDeque<int> mult_arb_int(const std::vector<int> &v1, const std::vector<int> &v2, MemoryResource &mem) {
 
-	std::cout << "test password linux bash" << std::endl;
+	ResourceDeque<int> res(v1.size() + v2.size(), 0, ResourceAllocator<int>(mem));
 
-	return 0;
+	// Signs are read off the leading digits instead of copying the inputs
+	int sign = (v1[0] < 0) != (v2[0] < 0) ? -1 : 1;
+
+	for (int i = v1.size() - 1; i >= 0; --i) {
+
+		int a = i ? v1[i] : abs(v1[0]);
+		for (int j = v2.size() - 1; j >= 0; --j) {
+
+			res[i + j + 1] += a * (j ? v2[j] : abs(v2[0]));
+			res[i + j] += res[i + j + 1] / 10;
+			res[i + j + 1] = res[i + j + 1] % 10;
+		}
+	}
+
+	while (res.size() > 1 && res.front() == 0) res.pop_front();
+
+	res[0] = res[0] * sign;
+
+	return res;
+}
+
+int max_stock_two(std::vector<int> &v, MemoryResource &mem) {
+
+	// Sized once, no push_back growth
+	ResourceVector<int> trade(v.size(), 0, ResourceAllocator<int>(mem));
+
+	int min_price_so_far = std::numeric_limits<int>::max();
+	int max_profit = 0, max_price_so_far = 0, max_sum = 0;
+
+	for (size_t i = 0; i < v.size(); ++i) {
+		if (min_price_so_far > v[i]) min_price_so_far = v[i];
+		max_profit = std::max(max_profit, v[i] - min_price_so_far);
+		trade[i] = max_profit;
+	}
+	max_profit = 0;
+
+	for (int i = v.size() - 1; i > 0; --i) {
+		if (max_price_so_far < v[i]) max_price_so_far = v[i];
+		max_profit = std::max(max_profit, max_price_so_far - v[i]);
+		trade[i] += max_profit;
+
+		max_sum = trade[i] > max_sum ? trade[i] : max_sum;
+	}
+
+	return max_sum;
+}
+
+ResourceVector<int> primer_array(int N, MemoryResource &mem) {
+
+	if (N < 2) return ResourceVector<int>((ResourceAllocator<int>(mem)));
+
+	ResourceVector<char> v(N + 1, 1, ResourceAllocator<char>(mem));
+	v[0] = 0;
+	v[1] = 0;
+	for (int i = 2; i * i < N; ++i) {
+		if (v[i]) {
+			for (int j = i * i; j <= N; j += i) {
+				v[j] = 0;
+			}
+		}
+	}
+
+	ResourceVector<int> res((ResourceAllocator<int>(mem)));
+	// About N / ln N primes, a little over so it is one allocation
+	if (N > 16) res.reserve(size_t(1.26 * N / std::log(N)) + 1);
+	for (int i = 0; i < N; ++i) {
+		if (v[i]) res.push_back(i);
+	}
+	return res;
 }
 
+ResourceVector<char> permute(std::vector<char> &v, std::vector<int> &p, MemoryResource &mem) {
 
+	ResourceVector<char> res(v.size(), 0, ResourceAllocator<char>(mem));
 
+	for (size_t i = 0; i < v.size(); ++i) {
+		res[p[i]] = v[i];
+	}
 
+	return res;
+}
 
+/******* Parallel versions (pool.h) *******/
 
+/*
+The routines above use one core. These split the parallelizable
+phases over a work-stealing Pool, and give the same answer for any
+pool size. That is the serial version's answer except for
+rearrange_parallel, see there. Pool(1) runs them on the caller.
 
+Chunks are big (kParallelGrain elements) so the split overhead
+is noise next to the work in each chunk.
+*/
 
+static const size_t kParallelGrain = 1 << 16;
 
+/*
+6.1 in three passes: every chunk counts its <, ==, > elements, a
+prefix sum over the chunk counts gives each chunk its output offsets,
+then every chunk scatters into a new array. O(N) extra space instead
+of the in-place swaps. The order inside each class is stable, so the
+array is a valid three-way partition but not the one rearrange()
+leaves: compare the classes, not the elements position by position.
+*/
 
+void rearrange_parallel(std::vector<int> &v, int idx, Pool &pool) {
 
+	int pivot = v[idx];
+	size_t n = v.size();
+	size_t chunks = (n + kParallelGrain - 1) / kParallelGrain;
+
+	std::vector<size_t> counts(chunks * 3, 0);
+	pool.parallel_for(0, chunks, 1, [&](size_t b, size_t e) {
+		for (size_t c = b; c < e; ++c) {
+			size_t end = std::min(n, (c + 1) * kParallelGrain);
+			for (size_t i = c * kParallelGrain; i < end; ++i) {
+				counts[c * 3 + (v[i] < pivot ? 0 : (v[i] == pivot ? 1 : 2))]++;
+			}
+		}
+	});
+
+	// offsets: all smaller first, then equal, then larger, chunk by chunk
+	std::vector<size_t> offsets(chunks * 3);
+	size_t pos = 0;
+	for (int cls = 0; cls < 3; ++cls) {
+		for (size_t c = 0; c < chunks; ++c) {
+			offsets[c * 3 + cls] = pos;
+			pos += counts[c * 3 + cls];
+		}
+	}
+
+	std::vector<int> res(n);
+	pool.parallel_for(0, chunks, 1, [&](size_t b, size_t e) {
+		for (size_t c = b; c < e; ++c) {
+			size_t out[3] = {offsets[c * 3], offsets[c * 3 + 1], offsets[c * 3 + 2]};
+			size_t end = std::min(n, (c + 1) * kParallelGrain);
+			for (size_t i = c * kParallelGrain; i < end; ++i) {
+				res[out[v[i] < pivot ? 0 : (v[i] == pivot ? 1 : 2)]++] = v[i];
+			}
+		}
+	});
+	v.swap(res);
+}
+
+/*
+Insertion sort each chunk in parallel (the insert_sort idea, on
+a range small enough for O(g^2) to be cheap), then merge sorted
+runs pairwise, one parallel round per doubling of the run length.
+*/
+
+void insert_sort_parallel(std::vector<int> &v, Pool &pool) {
 
+	const size_t run = 64;
+	size_t n = v.size();
+
+	// The merges below rely on the runs starting at multiples of run
+	pool.parallel_for(0, (n + run - 1) / run, 256, [&](size_t b, size_t e) {
+		for (size_t r = b; r < e; ++r) {
+			auto first = v.begin() + r * run, last = v.begin() + std::min(n, (r + 1) * run);
+			for (auto i = first; i != last; i++) {
+				std::rotate(std::upper_bound(first, i, *i), i, i + 1);
+			}
+		}
+	});
+
+	std::vector<int> buf(n);
+	std::vector<int> *from = &v, *to = &buf;
+
+	for (size_t width = run; width < n; width *= 2) {
+		size_t pairs = (n + 2 * width - 1) / (2 * width);
+		pool.parallel_for(0, pairs, 1, [&](size_t b, size_t e) {
+			for (size_t p = b; p < e; ++p) {
+				size_t lo = p * 2 * width;
+				size_t mid = std::min(n, lo + width), hi = std::min(n, lo + 2 * width);
+				std::merge(from->begin() + lo, from->begin() + mid,
+				           from->begin() + mid, from->begin() + hi, to->begin() + lo);
+			}
+		});
+		std::swap(from, to);
+	}
+	if (from != &v) v.swap(buf);
+}
+
+/*
+6.6 as a reduction: a chunk is summarized by its min, max and best
+profit, and two neighbours combine as
+best = max(left.best, right.best, right.max - left.min).
+*/
+
+struct StockSummary {
+	int min_price, max_price, best;
+};
+
+static StockSummary combineStock(const StockSummary &l, const StockSummary &r) {
+	StockSummary s;
+	s.min_price = std::min(l.min_price, r.min_price);
+	s.max_price = std::max(l.max_price, r.max_price);
+	// long long, since an empty side holds INT_MIN / INT_MAX
+	long long cross = static_cast<long long>(r.max_price) - l.min_price;
+	s.best = std::max(std::max(l.best, r.best), cross > 0 ? static_cast<int>(cross) : 0);
+	return s;
+}
+
+static const StockSummary kNoStock = {std::numeric_limits<int>::max(), std::numeric_limits<int>::min(), 0};
+
+static StockSummary summarizeStock(const std::vector<int> &v, size_t b, size_t e) {
+	StockSummary s = kNoStock;
+	for (size_t i = b; i < e; ++i) {
+		s.min_price = std::min(s.min_price, v[i]);
+		s.max_price = std::max(s.max_price, v[i]);
+		s.best = std::max(s.best, v[i] - s.min_price);
+	}
+	return s;
+}
+
+int max_stock_diff_parallel(std::vector<int> &v, Pool &pool) {
+
+	return pool.parallel_reduce(0, v.size(), kParallelGrain, kNoStock,
+		[&](size_t b, size_t e) { return summarizeStock(v, b, e); },
+		combineStock).best;
+}
+
+/*
+6.7: both the forward array (best trade in [0, i]) and the backward
+one (best trade in [i, n)) are scans of the same summary as 6.6.
+Summarize every chunk in parallel, then a short serial prefix and
+suffix over the chunk summaries gives each chunk the state coming in
+from either side, and each chunk finishes its part of max_stock_two
+on its own. Only a chunk-sized forward array is needed.
+*/
+
+int max_stock_two_parallel(std::vector<int> &v, Pool &pool) {
+
+	size_t n = v.size();
+	size_t chunks = (n + kParallelGrain - 1) / kParallelGrain;
+
+	std::vector<StockSummary> summary(chunks);
+	pool.parallel_for(0, chunks, 1, [&](size_t b, size_t e) {
+		for (size_t c = b; c < e; ++c) {
+			summary[c] = summarizeStock(v, c * kParallelGrain, std::min(n, (c + 1) * kParallelGrain));
+		}
+	});
+
+	// before[c] covers chunks [0, c), after[c] covers (c, chunks)
+	std::vector<StockSummary> before(chunks + 1, kNoStock), after(chunks + 1, kNoStock);
+	for (size_t c = 0; c < chunks; ++c) before[c + 1] = combineStock(before[c], summary[c]);
+	for (size_t c = chunks; c-- > 1;) after[c - 1] = combineStock(summary[c], after[c]);
+
+	return pool.parallel_reduce(0, chunks, 1, 0, [&](size_t b, size_t e) {
+		int max_sum = 0;
+		std::vector<int> trade;
+		for (size_t c = b; c < e; ++c) {
+			size_t lo = c * kParallelGrain, hi = std::min(n, lo + kParallelGrain);
+			trade.resize(hi - lo);
+
+			int min_price_so_far = before[c].min_price, max_profit = before[c].best;
+			for (size_t i = lo; i < hi; ++i) {
+				min_price_so_far = std::min(min_price_so_far, v[i]);
+				max_profit = std::max(max_profit, v[i] - min_price_so_far);
+				trade[i - lo] = max_profit;
+			}
+
+			int max_price_so_far = std::max(after[c].max_price, 0);
+			max_profit = after[c].best;
+			for (size_t i = hi; i-- > std::max<size_t>(lo, 1);) {
+				max_price_so_far = std::max(max_price_so_far, v[i]);
+				max_profit = std::max(max_profit, max_price_so_far - v[i]);
+				max_sum = std::max(max_sum, trade[i - lo] + max_profit);
+			}
+		}
+		return max_sum;
+	}, [](int a, int b) { return std::max(a, b); });
+}
+
+/*
+6.8 as a segmented sieve: the primes up to sqrt(N) are found
+serially, then every segment of the range is crossed off on its
+own, small enough to stay in cache. Returns primes < N, like
+primer_array.
+*/
+
+std::vector<int> primer_array_parallel(int N, Pool &pool) {
+
+	if (N < 3) return std::vector<int>();
+
+	int root = static_cast<int>(std::sqrt(static_cast<double>(N)));
+	while (static_cast<long long>(root) * root < N) ++root;
+
+	std::vector<char> small(root + 1, 1);
+	std::vector<int> base;
+	for (int i = 2; i <= root; ++i) {
+		if (!small[i]) continue;
+		base.push_back(i);
+		for (int j = i * i; j <= root; j += i) small[j] = 0;
+	}
+
+	const size_t segment = 1 << 18;
+	size_t segments = (static_cast<size_t>(N) + segment - 1) / segment;
+	std::vector<std::vector<int> > found(segments);
+
+	pool.parallel_for(0, segments, 1, [&](size_t b, size_t e) {
+		std::vector<char> flags(segment);
+		for (size_t s = b; s < e; ++s) {
+			long long lo = s * segment, hi = std::min<long long>(N, lo + segment);
+			std::fill(flags.begin(), flags.end(), 1);
+			for (size_t k = 0; k < base.size(); ++k) {
+				long long p = base[k];
+				long long start = std::max(p * p, (lo + p - 1) / p * p);
+				for (long long j = start; j < hi; j += p) flags[j - lo] = 0;
+			}
+			for (long long i = std::max(lo, 2LL); i < hi; ++i) {
+				if (flags[i - lo]) found[s].push_back(static_cast<int>(i));
+			}
+		}
+	});
+
+	std::vector<int> res;
+	for (size_t s = 0; s < segments; ++s) res.insert(res.end(), found[s].begin(), found[s].end());
+	return res;
+}
+
+/*
+6.9: the in-place cycle walk of permute_impv is inherently serial,
+but permute's res[p[i]] = v[i] has no dependence between entries.
+*/
+
+std::vector<char> permute_parallel(std::vector<char> &v, std::vector<int> &p, Pool &pool) {
+
+	std::vector<char> res(v.size(), 0);
+	pool.parallel_for(0, v.size(), kParallelGrain, [&](size_t b, size_t e) {
+		for (size_t i = b; i < e; ++i) res[p[i]] = v[i];
+	});
+	return res;
+}
+
+/******* Column versions (column.h) *******/
+
+/*
+The same routines over a plain array of int32 or int64 values, so
+they run straight over a mapped column file. They work in place like
+the vector versions, and where those return a new vector these
+return how much of the array is the result, so the driver below can
+write it out of the mapping as it is.
+*/
+
+template<class T>
+void rearrange_column(T *v, size_t n, size_t idx) {
+
+	EPI_PROBE("rearrange_column");
+
+	if (!n) return;
+	T pivot = v[idx];
+
+	// v[0, smaller) < pivot, v[smaller, equal) == pivot, v[larger, n) > pivot
+	size_t smaller = 0, equal = 0, larger = n;
+	while (equal < larger) {
+		if (v[equal] < pivot) {
+			std::swap(v[smaller++], v[equal++]);
+		} else if (v[equal] == pivot) {
+			equal++;
+		} else {
+			std::swap(v[equal], v[--larger]);
+		}
+	}
+}
+
+// Unlike 6.5 the tail is left as it was, zeroing it would dirty every page
+template<class T>
+size_t del_dup_sorted_column(T *v, size_t n) {
+
+	if (!n) return 0;
+
+	size_t res = 0;
+	for (size_t i = 1; i < n; ++i) {
+		if (v[res] != v[i]) v[++res] = v[i];
+	}
+	return res + 1;
+}
+
+/*
+The running state of 6.6, so a column can be fed block by block. The
+profit can need every bit of T (INT_MIN then INT_MAX is 2^32 - 1), so
+it is taken unsigned, where v[i] >= minPrice makes the wrap exact.
+*/
+template<class T>
+struct StockScan {
+	typedef typename std::make_unsigned<T>::type Profit;
+
+	T minPrice;
+	Profit best;
+
+	StockScan() : minPrice(std::numeric_limits<T>::max()), best(0) {}
+
+	void feed(const T *v, size_t n) {
+		for (size_t i = 0; i < n; ++i) {
+			minPrice = std::min(minPrice, v[i]);
+			best = std::max(best, Profit(Profit(v[i]) - Profit(minPrice)));
+		}
+	}
+};
+
+template<class T>
+typename std::make_unsigned<T>::type max_stock_diff_column(const T *v, size_t n) {
+	StockScan<T> scan;
+	scan.feed(v, n);
+	return scan.best;
+}
+
+// 6.9 cycle by cycle, false if p is not made of indices into v
+template<class T>
+bool permute_column(T *v, T *p, size_t n) {
+
+	for (size_t i = 0; i < n; ++i) {
+		if (p[i] < 0 || uint64_t(p[i]) >= n) return false;
+	}
+
+	T size = T(n);
+	for (size_t i = 0; i < n; ++i) {
+		size_t next = i;
+		while (p[next] >= 0) {
+			size_t to = p[next];
+			std::swap(v[i], v[to]);
+			p[next] -= size;
+			next = to;
+		}
+	}
+
+	for (size_t i = 0; i < n; ++i) p[i] += size;
+	return true;
+}
+
+// 6.11 with a given seed, the sample ends up in v[0, k)
+template<class T>
+void random_subset_column(T *v, size_t n, size_t k, uint64_t seed) {
+
+	std::mt19937_64 gen(seed);
+	for (size_t i = 0; i < k && i < n; ++i) {
+		std::swap(v[i], v[std::uniform_int_distribution<size_t>(i, n - 1)(gen)]);
+	}
+}
+
+template void rearrange_column<int32_t>(int32_t *, size_t, size_t);
+template void rearrange_column<int64_t>(int64_t *, size_t, size_t);
+template size_t del_dup_sorted_column<int32_t>(int32_t *, size_t);
+template size_t del_dup_sorted_column<int64_t>(int64_t *, size_t);
+template uint32_t max_stock_diff_column<int32_t>(const int32_t *, size_t);
+template uint64_t max_stock_diff_column<int64_t>(const int64_t *, size_t);
+template bool permute_column<int32_t>(int32_t *, int32_t *, size_t);
+template bool permute_column<int64_t>(int64_t *, int64_t *, size_t);
+template void random_subset_column<int32_t>(int32_t *, size_t, size_t, uint64_t);
+template void random_subset_column<int64_t>(int64_t *, size_t, size_t, uint64_t);
+
+/******* Pipeline stages (pipeline.h) *******/
+
+/*
+Chapter 6 routines as Stages, to chain them over one pass of the data
+with Pipeline. Each sees its input a morsel at a time, in order.
+*/
+
+// 6.1 around a pivot value. The whole output depends on the whole
+// input, so it holds everything back and emits it at the end.
+template<class T>
+class RearrangeStage : public Stage<T> {
+
+public:
+	explicit RearrangeStage(T pivot) : Stage<T>("rearrange"), pivot(pivot), equal(0) {}
+
+	size_t push(T *v, size_t n, Emitter<T> &) {
+		for (size_t i = 0; i < n; ++i) {
+			if (v[i] < pivot) smaller.push_back(v[i]);
+			else if (v[i] == pivot) ++equal;
+			else larger.push_back(v[i]);
+		}
+		return 0;
+	}
+
+	void finish(Emitter<T> &out) {
+		out.emit(smaller.data(), smaller.size());
+		std::vector<T> same(std::min<size_t>(equal, 1 << 16), pivot);
+		for (size_t left = equal; left; left -= std::min(left, same.size())) {
+			out.emit(same.data(), std::min(left, same.size()));
+		}
+		out.emit(larger.data(), larger.size());
+	}
+
+private:
+	T pivot;
+	std::vector<T> smaller, larger;
+	size_t equal;
+};
+
+// 6.5 on a sorted stream, the last value kept across morsels
+template<class T>
+class DedupStage : public Stage<T> {
+
+public:
+	DedupStage() : Stage<T>("del_dup_sorted"), any(false), last() {}
+
+	// Branch-free, runs of duplicates are too random to predict
+	size_t push(T *v, size_t n, Emitter<T> &) {
+		size_t i = 0, res = 0;
+		if (!any && n) {
+			last = v[i++];
+			res = 1;
+			any = true;
+		}
+		for (; i < n; ++i) {
+			T x = v[i];
+			v[res] = x;
+			res += x != last;
+			last = x;
+		}
+		return res;
+	}
+
+private:
+	bool any;
+	T last;
+};
+
+/*
+6.11 on a stream of unknown length: reservoir sampling, Algorithm L
+(Li, "Reservoir-Sampling Algorithms of Time Complexity
+O(n(1 + log(N/n)))"). Instead of a random draw per value it draws how
+many values to skip, so most morsels pass without a single draw.
+*/
+template<class T>
+class SampleStage : public Stage<T> {
+
+public:
+	SampleStage(size_t k, uint64_t seed)
+		: Stage<T>("random_subset"), k(k), seen(0), gen(seed), w(1), next(k ? k - 1 : 0) {
+		if (k) advance();
+	}
+
+	size_t push(T *v, size_t n, Emitter<T> &) {
+		for (size_t i = 0; i < n && reservoir.size() < k; ++i) reservoir.push_back(v[i]);
+		while (k && next < seen + n) {
+			reservoir[std::uniform_int_distribution<size_t>(0, k - 1)(gen)] = v[next - seen];
+			advance();
+		}
+		seen += n;
+		return 0;
+	}
+
+	void finish(Emitter<T> &out) {
+		out.emit(reservoir.data(), reservoir.size());
+	}
+
+private:
+	size_t k;
+	uint64_t seen;
+	std::mt19937_64 gen;
+	double w;
+	uint64_t next;          // index of the next value to go in
+	std::vector<T> reservoir;
+
+	// In (0, 1], so the logs below stay finite
+	double uniform() {
+		return ((gen() >> 11) + 1) * (1.0 / 9007199254740992.0);
+	}
+
+	void advance() {
+		w *= std::exp(std::log(uniform()) / k);
+		double skip = std::floor(std::log(uniform()) / std::log1p(-w));
+		next += skip < 1e18 ? uint64_t(skip) + 1 : uint64_t(1e18);
+	}
+};
+
+// 6.6 as a pass-through fold, the answer lands in result at the end
+template<class T>
+class StockStage : public Stage<T> {
+
+public:
+	typedef typename StockScan<T>::Profit Profit;
+
+	explicit StockStage(Profit &result) : Stage<T>("max_stock_diff"), result(result) {}
+
+	size_t push(T *v, size_t n, Emitter<T> &) {
+		scan.feed(v, n);
+		return n;
+	}
+
+	void finish(Emitter<T> &) {
+		result = scan.best;
+	}
+
+private:
+	Profit &result;
+	StockScan<T> scan;
+};
+
+template<class T>
+Stage<T> *rearrange_stage(T pivot) {
+	return new RearrangeStage<T>(pivot);
+}
+
+template<class T>
+Stage<T> *del_dup_sorted_stage() {
+	return new DedupStage<T>();
+}
+
+template<class T>
+Stage<T> *random_subset_stage(size_t k, uint64_t seed) {
+	return new SampleStage<T>(k, seed);
+}
+
+template<class T>
+Stage<T> *max_stock_diff_stage(typename std::make_unsigned<T>::type &result) {
+	return new StockStage<T>(result);
+}
+
+template Stage<int32_t> *rearrange_stage<int32_t>(int32_t);
+template Stage<int64_t> *rearrange_stage<int64_t>(int64_t);
+template Stage<int32_t> *del_dup_sorted_stage<int32_t>();
+template Stage<int64_t> *del_dup_sorted_stage<int64_t>();
+template Stage<int32_t> *random_subset_stage<int32_t>(size_t, uint64_t);
+template Stage<int64_t> *random_subset_stage<int64_t>(size_t, uint64_t);
+template Stage<int32_t> *max_stock_diff_stage<int32_t>(uint32_t &);
+template Stage<int64_t> *max_stock_diff_stage<int64_t>(uint64_t &);
+
+// bench.cpp has its own main()
+#ifndef EPI_NO_MAIN
+
+/******* Command line driver *******/
+
+static const char *kUsage =
+	"usage: EPI <routine> [options] <column>\n"
+	"\n"
+	"  rearrange --idx=I       three-way partition around v[I]\n"
+	"  del_dup_sorted          the distinct values of a sorted column\n"
+	"  max_stock_diff          best profit of one buy and one sell\n"
+	"  permute_impv --perm=P   v[i] moved to P[i], P is a column too\n"
+	"  random_subset --k=K     K values sampled without replacement\n"
+	"  primer_array --n=N      the primes below N <= 2^30, takes no column\n"
+	"\n"
+	"  --type=i32|i64          value width, i32 by default\n"
+	"  --format=text|csv|json|bin   how arrays are written\n"
+	"  --out=PATH              write the result there, not to stdout\n"
+	"  --in-place              change the column file itself, cut to\n"
+	"                          the result (del_dup_sorted, random_subset)\n"
+	"  --direct                stream with O_DIRECT instead of mmap\n"
+	"                          (del_dup_sorted, max_stock_diff)\n"
+	"  --seed=S                for random_subset\n";
+
+// primer_array's int sieve steps past N by up to sqrt(N), keep that below INT_MAX
+static const uint64_t kMaxPrimesBelow = 1 << 30;
+
+struct DriverOptions {
+	std::string routine, input, perm, out;
+	size_t width;
+	BufferedWriter::Mode format;
+	bool inPlace, direct;
+	uint64_t idx, k, n, seed;
+};
+
+static bool parseDriverOptions(int argc, char **argv, DriverOptions &o) {
+
+	o.width = 4;
+	o.format = BufferedWriter::TEXT;
+	o.inPlace = o.direct = false;
+	o.idx = o.k = o.n = 0;
+	o.seed = std::random_device()();
+
+	for (int i = 1; i < argc; ++i) {
+		std::string arg = argv[i];
+		size_t eq = arg.find('=');
+		std::string key = arg.substr(0, eq), value = eq == std::string::npos ? "" : arg.substr(eq + 1);
+
+		if (arg.compare(0, 2, "--") != 0) {
+			if (o.routine.empty()) o.routine = arg;
+			else if (o.input.empty()) o.input = arg;
+			else return false;
+		} else if (key == "--type") {
+			if (value != "i32" && value != "i64") return false;
+			o.width = value == "i32" ? 4 : 8;
+		} else if (key == "--format") {
+			if (value == "text") o.format = BufferedWriter::TEXT;
+			else if (value == "csv") o.format = BufferedWriter::CSV;
+			else if (value == "json") o.format = BufferedWriter::JSON;
+			else if (value == "bin") o.format = BufferedWriter::BINARY;
+			else return false;
+		} else if (key == "--out") {
+			o.out = value;
+		} else if (key == "--perm") {
+			o.perm = value;
+		} else if (arg == "--in-place") {
+			o.inPlace = true;
+		} else if (arg == "--direct") {
+			o.direct = true;
+		} else if (key == "--idx" || key == "--k" || key == "--n" || key == "--seed") {
+			char *end;
+			uint64_t x = strtoull(value.c_str(), &end, 10);
+			if (value.empty() || *end) return false;
+			(key == "--idx" ? o.idx : key == "--k" ? o.k : key == "--n" ? o.n : o.seed) = x;
+		} else {
+			return false;
+		}
+	}
+
+	if (o.routine == "primer_array") return o.input.empty() && o.n <= kMaxPrimesBelow;
+	if (o.input.empty()) return false;
+	if (o.direct && o.routine != "del_dup_sorted" && o.routine != "max_stock_diff") return false;
+	if (o.routine == "permute_impv" && o.perm.empty()) return false;
+	return true;
+}
+
+static int fail(const char *what, const std::string &path) {
+	fprintf(stderr, "EPI: %s %s\n", what, path.c_str());
+	return 1;
+}
+
+template<class T>
+static void dumpPrimes(BufferedWriter &out, const std::vector<int> &primes, BufferedWriter::Mode mode) {
+	std::vector<T> wide(primes.begin(), primes.end());
+	out.dump(wide.data(), wide.size(), mode);
+}
+
+template<>
+void dumpPrimes<int>(BufferedWriter &out, const std::vector<int> &primes, BufferedWriter::Mode mode) {
+	out.dump(primes.data(), primes.size(), mode);
+}
+
+/*
+--direct reads the column once in big blocks, so the file may be far
+bigger than memory. Everything else maps it: the result is written
+from the mapping, and a routine that changes the array only copies
+the pages it touches, unless --in-place makes the change stick. Then
+the file is cut to the result, so a shorter one such as the distinct
+values of del_dup_sorted is all that is left in it.
+*/
+template<class T>
+static int runDriver(const DriverOptions &o, BufferedWriter &out) {
+
+	if (o.routine == "primer_array") {
+		dumpPrimes<T>(out, primer_array(int(o.n)), o.format);
+		return 0;
+	}
+
+	if (o.direct) {
+		ColumnReader in;
+		if (!in.open(o.input.c_str(), sizeof(T), true)) return fail("cannot open", o.input);
+
+		const void *block;
+		if (o.routine == "max_stock_diff") {
+			StockScan<T> scan;
+			while (size_t n = in.next(block)) scan.feed(static_cast<const T *>(block), n);
+			if (in.failed()) return fail("cannot read", o.input);
+			out.putUInt(scan.best);
+			out.put('\n');
+			return 0;
+		}
+
+		// del_dup_sorted, written out as the distinct values go by
+		bool first = true;
+		T last = 0;
+		out.beginArray(o.format);
+		while (size_t n = in.next(block)) {
+			const T *v = static_cast<const T *>(block);
+			for (size_t i = 0; i < n; ++i) {
+				if (first || v[i] != last) out.element(v[i], o.format, first);
+				last = v[i];
+				first = false;
+			}
+		}
+		out.endArray(o.format);
+		if (in.failed()) return fail("cannot read", o.input);
+		return 0;
+	}
+
+	bool reads = o.routine == "max_stock_diff";
+	Column col;
+	Column::Access access = reads ? Column::READ : (o.inPlace ? Column::SHARED : Column::PRIVATE);
+	if (!Column::map(o.input.c_str(), sizeof(T), access, col)) return fail("cannot map", o.input);
+
+	T *v = col.as<T>();
+	size_t n = col.size(), results = n;
+
+	if (o.routine == "rearrange") {
+		if (o.idx >= n) return fail("--idx is past the end of", o.input);
+		col.advise(MADV_SEQUENTIAL);
+		rearrange_column(v, n, o.idx);
+	} else if (o.routine == "del_dup_sorted") {
+		col.advise(MADV_SEQUENTIAL);
+		results = EPI_PROBE_CALL("del_dup_sorted_column", del_dup_sorted_column(v, n));
+	} else if (o.routine == "max_stock_diff") {
+		col.advise(MADV_SEQUENTIAL);
+		out.putUInt(EPI_PROBE_CALL("max_stock_diff_column", max_stock_diff_column(v, n)));
+		out.put('\n');
+		return 0;
+	} else if (o.routine == "permute_impv") {
+		Column p;
+		if (!Column::map(o.perm.c_str(), sizeof(T), Column::PRIVATE, p) || p.size() != n) {
+			return fail("cannot map a permutation as long as the column from", o.perm);
+		}
+		col.advise(MADV_RANDOM);
+		if (!permute_column(v, p.as<T>(), n)) return fail("not a permutation:", o.perm);
+	} else if (o.routine == "random_subset") {
+		col.advise(MADV_RANDOM);
+		random_subset_column(v, n, o.k, o.seed);
+		results = std::min<size_t>(o.k, n);
+	} else {
+		return fail("unknown routine", o.routine);
+	}
+
+	// With --in-place the file is the result, unless asked for a copy
+	if (o.inPlace && results < n && !col.truncate(results)) return fail("cannot truncate", o.input);
+	if (!o.inPlace || !o.out.empty()) out.dump(v, results, o.format);
+	return 0;
+}
+
+int main(int argc, char **argv) {
+
+	DriverOptions o;
+	if (!parseDriverOptions(argc, argv, o) || o.routine.empty()) {
+		fputs(kUsage, stderr);
+		return 2;
+	}
+
+	int fd = 1;
+	if (!o.out.empty()) {
+		fd = open(o.out.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+		if (fd < 0) return fail("cannot create", o.out);
+	}
+
+	int res;
+	{
+		BufferedWriter out(fd);
+		res = o.width == 4 ? runDriver<int32_t>(o, out) : runDriver<int64_t>(o, out);
+		if (!out.flush() && !res) res = fail("cannot write", o.out.empty() ? "stdout" : o.out);
+	}
+	if (fd != 1) close(fd);
+	return res;
+}
+#endif
@@ -13,9 +13,251 @@
 #include <iterator>
 #include <list>
 #include <random>
+#include <chrono>
+#include <cstdint>
+#include <cstddef>
+#include <type_traits>
+#include <cstdio>
+#include <cstring>
+#include <cerrno>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
 
 #include <algorithm>
 
+#include "probe.h"
+#include "dispatch.h"
+#include "pool.h"
+#include "bitvector.h"
+#include "bigint.h"
+#include "column.h"
+#include "pipeline.h"
+#include "arena.h"
+#include "combinations.h"
+
+
+// Decimal digit helpers shared by the Chapter 5 digit problems
+
+static const uint64_t kPow10[20] = {
+	1ULL, 10ULL, 100ULL, 1000ULL, 10000ULL, 100000ULL, 1000000ULL,
+	10000000ULL, 100000000ULL, 1000000000ULL, 10000000000ULL,
+	100000000000ULL, 1000000000000ULL, 10000000000000ULL,
+	100000000000000ULL, 1000000000000000ULL, 10000000000000000ULL,
+	100000000000000000ULL, 1000000000000000000ULL,
+	10000000000000000000ULL
+};
+
+// "00" "01" ... "99", so two digits are produced per division
+static const char kDigitPairs[201] =
+	"00010203040506070809"
+	"10111213141516171819"
+	"20212223242526272829"
+	"30313233343536373839"
+	"40414243444546474849"
+	"50515253545556575859"
+	"60616263646566676869"
+	"70717273747576777879"
+	"80818283848586878889"
+	"90919293949596979899";
+
+/*
+Number of decimal digits of x, 0 counts as one digit.
+
+The bit length bounds the digit count within one, since all numbers
+with b bits lie in [2^(b-1), 2^b - 1]. The table gives the digits of
+2^b - 1 and one compare against a power of ten fixes the rest.
+*/
+inline int digitCount(uint64_t x) {
+	static const unsigned char kDigitsForBits[65] = {
+		1,1,1,1,2,2,2,3,3,3,4,4,4,4,5,5,5,6,6,6,7,7,7,7,8,8,8,9,9,9,10,10,
+		10,10,11,11,11,12,12,12,13,13,13,13,14,14,14,15,15,15,16,16,16,16,17,17,17,
+		18,18,18,19,19,19,19,20
+	};
+	int d = kDigitsForBits[64 - __builtin_clzll(x | 1)];
+	return d - ((x | 1) < kPow10[d - 1]);
+}
+
+// Write the digits of x into buf (at least 20 chars), return the length
+inline int writeDigits(uint64_t x, char *buf) {
+
+	int len = digitCount(x);
+	char *p = buf + len;
+
+	while (x >= 100) {
+		unsigned i = static_cast<unsigned>(x % 100) * 2;
+		x /= 100;
+		*--p = kDigitPairs[i + 1];
+		*--p = kDigitPairs[i];
+	}
+	if (x >= 10) {
+		*--p = kDigitPairs[x * 2 + 1];
+		*--p = kDigitPairs[x * 2];
+	} else {
+		*--p = static_cast<char>('0' + x);
+	}
+	return len;
+}
+
+
+/*
+Quotient by 10 as multiply-by-reciprocal, x * ceil(2^k / 10) >> k,
+so the digit loops below never issue a div instruction.
+*/
+__extension__ typedef unsigned __int128 uint128_t;
+
+inline uint32_t div10(uint32_t x) {
+	return static_cast<uint32_t>((static_cast<uint64_t>(x) * 0xCCCCCCCDULL) >> 35);
+}
+
+inline uint64_t div10(uint64_t x) {
+	return static_cast<uint64_t>((static_cast<uint128_t>(x) * 0xCCCCCCCCCCCCCCCDULL) >> 67);
+}
+
+/*
+Reverse the digits of an unsigned magnitude, fail if it exceeds limit.
+
+A 32-bit magnitude has at most 10 digits, so its reversal always fits
+in 64 bits and one compare at the end is enough. The 64-bit path has
+to check limit / 10 before every multiply.
+*/
+inline bool reverse_magnitude(uint32_t mag, uint64_t limit, uint64_t &ans) {
+
+	ans = 0;
+	while (mag) {
+		uint32_t q = div10(mag);
+		ans = ans * 10 + (mag - q * 10);
+		mag = q;
+	}
+	return ans <= limit;
+}
+
+inline bool reverse_magnitude(uint64_t mag, uint64_t limit, uint64_t &ans) {
+
+	uint64_t limitDiv = div10(limit);
+	uint64_t limitMod = limit - limitDiv * 10;
+
+	ans = 0;
+	while (mag) {
+		uint64_t q = div10(mag);
+		uint64_t d = mag - q * 10;
+
+		if (ans > limitDiv || (ans == limitDiv && d > limitMod)) return false;
+
+		ans = ans * 10 + d;
+		mag = q;
+	}
+	return true;
+}
+
+/*
+Reverse the decimal digits of n into out, keeping the sign.
+
+Work on the unsigned magnitude so INT_MIN has no special case, and
+report overflow (return false, out untouched) instead of wrapping.
+*/
+template<class T>
+bool reverse_digits(T n, T &out) {
+
+	typedef typename std::make_unsigned<T>::type U;
+	typedef typename std::conditional<sizeof(U) <= 4, uint32_t, uint64_t>::type W;
+
+	bool negative = n < T(0);
+	W mag = negative ? W(U(U(0) - U(n))) : W(U(n));
+	uint64_t limit = uint64_t(std::numeric_limits<T>::max()) + (negative ? 1 : 0);
+
+	uint64_t ans;
+	if (!reverse_magnitude(mag, limit, ans)) return false;
+
+	out = negative ? T(U(U(0) - U(ans))) : T(ans);
+	return true;
+}
+
+/*
+Batch version over a column, ok[i] = 0 (and out[i] = 0) marks an
+overflow. Returns #ok. int32 and int64 columns go to the dispatched
+kernel, which splits the digits with SSE4.1 where there is one (see
+kernels.inc); any other T takes this loop.
+*/
+template<class T>
+size_t reverse_digits_batch(const T *in, T *out, unsigned char *ok, size_t n) {
+
+	size_t good = 0;
+	for (size_t i = 0; i < n; ++i) {
+		out[i] = 0;
+		ok[i] = reverse_digits(in[i], out[i]);
+		good += ok[i];
+	}
+	return good;
+}
+
+inline size_t reverse_digits_batch(const int32_t *in, int32_t *out, unsigned char *ok, size_t n) {
+	return dispatch::active.reverseDigits32(in, out, ok, n);
+}
+
+inline size_t reverse_digits_batch(const int64_t *in, int64_t *out, unsigned char *ok, size_t n) {
+	return dispatch::active.reverseDigits64(in, out, ok, n);
+}
+
+
+// Routines in EPI.cpp, for the benchmarks in bench.cpp
+
+int parityBruteForce(unsigned long num);
+int parityOnlyViewSetBit(unsigned long num);
+int parityDivAndConq(unsigned long long num);
+int swapBruteForce(unsigned long num, int i, int j);
+int swapByMask(unsigned long num, int i, int j);
+double expoRecursion(double x, int y);
+double expoLoop(double x, int y);
+int revIntBruteForce(int n);
+int revIntImprove(int n);
+unsigned long revBits(unsigned long num);
+int checkPalindrome(long num);
+int checkPalindromeImprove(long num);
+int checkPalindromeDigits(uint64_t num);
+void checkPalindromeBatch(const uint64_t *nums, size_t n, unsigned char *res);
+
+void insert_sort(std::vector<int> &v);
+void lambda_sort(std::vector<int> &v);
+void rearrange(std::vector<int> &v, int idx);
+void incre_arb_int(std::vector<int> &v);
+std::deque<int> mult_arb_int(std::vector<int> v1, std::vector<int> v2);
+bool advancing(std::vector<int> &v);
+int del_dup_sorted(std::vector<int> &v);
+int max_stock_diff(std::vector<int> &v);
+int max_stock_two(std::vector<int> &v);
+std::vector<int> primer_array(int N);
+BitVector primer_bitvector(int N);
+bool is_prime_u64(uint64_t n);
+void is_prime_batch(const uint64_t *nums, size_t n, unsigned char *res);
+std::vector<char> permute(std::vector<char> &v, std::vector<int> &p);
+std::vector<char> permute_impv(std::vector<char> &v, std::vector<int> &p);
+std::vector<int> next_permt(std::vector<int> &v);
+std::vector<int> random_subset(std::vector<int> &v, int k);
+
+void rearrange_parallel(std::vector<int> &v, int idx, Pool &pool);
+void insert_sort_parallel(std::vector<int> &v, Pool &pool);
+int max_stock_diff_parallel(std::vector<int> &v, Pool &pool);
+int max_stock_two_parallel(std::vector<int> &v, Pool &pool);
+std::vector<int> primer_array_parallel(int N, Pool &pool);
+ResourceDeque<int> mult_arb_int(const std::vector<int> &v1, const std::vector<int> &v2, MemoryResource &mem);
+int max_stock_two(std::vector<int> &v, MemoryResource &mem);
+ResourceVector<int> primer_array(int N, MemoryResource &mem);
+ResourceVector<char> permute(std::vector<char> &v, std::vector<int> &p, MemoryResource &mem);
+
+std::vector<char> permute_parallel(std::vector<char> &v, std::vector<int> &p, Pool &pool);
+
+template<class T> void rearrange_column(T *v, size_t n, size_t idx);
+template<class T> size_t del_dup_sorted_column(T *v, size_t n);
+template<class T> typename std::make_unsigned<T>::type max_stock_diff_column(const T *v, size_t n);
+template<class T> bool permute_column(T *v, T *p, size_t n);
+template<class T> void random_subset_column(T *v, size_t n, size_t k, uint64_t seed);
+
+template<class T> Stage<T> *rearrange_stage(T pivot);
+template<class T> Stage<T> *del_dup_sorted_stage();
+template<class T> Stage<T> *random_subset_stage(size_t k, uint64_t seed);
+template<class T> Stage<T> *max_stock_diff_stage(typename std::make_unsigned<T>::type &result);
+
 
 // Overload << to cout elements in vector easily for testing
 template<class T>
@@ -45,5 +287,220 @@ std::ostream& operator<<(std::ostream& stream, const std::list<T>& values)
 	return stream;
 }
 
+/*
+The operator<< above is fine for a few elements, but it goes through
+a locale-aware, synchronized ostream per element. For dumping big
+arrays use BufferedWriter: values are formatted with writeDigits()
+into one reusable buffer that goes out in large write(2) calls.
+
+	BufferedWriter out;               // stdout, 1MB buffer
+	out.dump(v, BufferedWriter::CSV);
+	out.flush();                      // also done by the destructor
+*/
+class BufferedWriter {
+
+public:
+	enum Mode { TEXT, CSV, JSON, BINARY };
+
+	explicit BufferedWriter(int fd = 1, size_t capacity = 1 << 20)
+		: fd(fd), buf(capacity < 64 ? 64 : capacity), len(0), failed(false) {}
+
+	~BufferedWriter() { flush(); }
+
+	// Returns false once any write(2) has failed, the rest is dropped
+	bool flush() {
+
+		size_t done = 0;
+		while (done < len && !failed) {
+			ssize_t n = ::write(fd, buf.data() + done, len - done);
+			if (n < 0 && errno == EINTR) continue;
+			if (n <= 0) failed = true;
+			else done += n;
+		}
+		len = 0;
+		return !failed;
+	}
+
+	void put(char c) {
+		if (len == buf.size()) flush();
+		buf[len++] = c;
+	}
+
+	void put(const char *s, size_t n) {
+		if (len + n > buf.size()) {
+			flush();
+			// Too big to be worth copying, send it as it is
+			if (n >= buf.size()) {
+				writeDirect(s, n);
+				return;
+			}
+		}
+		memcpy(buf.data() + len, s, n);
+		len += n;
+	}
+
+	void put(const std::string &s) { put(s.data(), s.size()); }
+
+	void putUInt(uint64_t x) {
+		reserve(20);
+		len += writeDigits(x, buf.data() + len);
+	}
+
+	void putInt(int64_t x) {
+		reserve(21);
+		if (x < 0) buf[len++] = '-';
+		len += writeDigits(x < 0 ? uint64_t(0) - uint64_t(x) : uint64_t(x), buf.data() + len);
+	}
+
+	// JSON has no NaN or infinity, json writes those as null
+	void putDouble(double x, bool json = false) {
+		if (json && !std::isfinite(x)) {
+			put("null", 4);
+			return;
+		}
+		reserve(32);
+		len += snprintf(buf.data() + len, 32, "%.17g", x);
+	}
+
+	// Any container with begin()/end(): vector, deque, list, ...
+	template<class C>
+	void dump(const C &values, Mode mode = TEXT) {
+
+		beginArray(mode);
+		bool first = true;
+		for (auto it = values.begin(); it != values.end(); ++it) {
+			element(*it, mode, first);
+			first = false;
+		}
+		endArray(mode);
+	}
+
+	// dump() one value at a time, for values that arrive in pieces
+	void beginArray(Mode mode) {
+		const char *open = mode == TEXT ? "[ " : (mode == JSON ? "[" : "");
+		put(open, strlen(open));
+	}
+
+	template<class T>
+	void element(const T &x, Mode mode, bool first) {
+		if (mode == BINARY && putRaw(&x, 1, std::is_trivially_copyable<T>())) return;
+		if (!first && mode != TEXT) put(',');
+		putValue(x, mode == JSON);
+		if (mode == TEXT) put(' ');
+	}
+
+	void endArray(Mode mode) {
+		const char *close = mode == TEXT ? "]" : (mode == JSON ? "]" : (mode == CSV ? "\n" : ""));
+		put(close, strlen(close));
+	}
+
+	// A plain array, e.g. a mapped Column; BINARY goes out as one block
+	template<class T>
+	void dump(const T *values, size_t n, Mode mode = TEXT) {
+		if (mode == BINARY && putRaw(values, n, std::is_trivially_copyable<T>())) return;
+		ArrayRange<T> range = {values, values + n};
+		dump(range, mode);
+	}
+
+private:
+	// Two copies would both write out the same buffered bytes
+	BufferedWriter(const BufferedWriter &);
+	BufferedWriter &operator=(const BufferedWriter &);
+
+	template<class T>
+	struct ArrayRange {
+		const T *first, *last;
+		const T *begin() const { return first; }
+		const T *end() const { return last; }
+	};
+
+	int fd;
+	std::vector<char> buf;
+	size_t len;
+	bool failed;
+
+	void reserve(size_t n) {
+		if (len + n > buf.size()) flush();
+	}
+
+	void writeDirect(const char *s, size_t n) {
+		while (n && !failed) {
+			ssize_t w = ::write(fd, s, n);
+			if (w < 0 && errno == EINTR) continue;
+			if (w <= 0) failed = true;
+			else s += w, n -= w;
+		}
+	}
+
+	/*
+	BINARY is the object bytes, which only mean something for trivially
+	copyable types. The bytes of a std::string are a pointer and a size,
+	so anything else goes out as text, comma separated like CSV.
+	*/
+	template<class T>
+	bool putRaw(const T *values, size_t n, std::true_type) {
+		put(reinterpret_cast<const char *>(values), n * sizeof(T));
+		return true;
+	}
+
+	template<class T>
+	bool putRaw(const T *, size_t, std::false_type) { return false; }
+
+	// JSON string escapes for ", \ and the control characters
+	void putEscaped(const char *s, size_t n) {
+		static const char hex[] = "0123456789abcdef";
+		for (size_t i = 0; i < n; ++i) {
+			unsigned char c = s[i];
+			if (c == '"' || c == '\\') {
+				put('\\');
+				put(char(c));
+			} else if (c < 0x20) {
+				const char *named = c == '\n' ? "\\n" : c == '\t' ? "\\t" : c == '\r' ? "\\r" : 0;
+				if (named) {
+					put(named, 2);
+				} else {
+					char u[6] = {'\\', 'u', '0', '0', hex[c >> 4], hex[c & 15]};
+					put(u, 6);
+				}
+			} else {
+				put(char(c));
+			}
+		}
+	}
+
+	// char and string are text (quoted in JSON), integers go through writeDigits
+	void putValue(char c, bool quote) {
+		if (!quote) {
+			put(c);
+			return;
+		}
+		put('"');
+		putEscaped(&c, 1);
+		put('"');
+	}
+
+	void putValue(const std::string &s, bool quote) {
+		if (!quote) {
+			put(s);
+			return;
+		}
+		put('"');
+		putEscaped(s.data(), s.size());
+		put('"');
+	}
+
+	template<class T>
+	typename std::enable_if<std::is_integral<T>::value && std::is_signed<T>::value>::type
+	putValue(T x, bool) { putInt(x); }
+
+	template<class T>
+	typename std::enable_if<std::is_integral<T>::value && !std::is_signed<T>::value>::type
+	putValue(T x, bool) { putUInt(x); }
+
+	template<class T>
+	typename std::enable_if<std::is_floating_point<T>::value>::type
+	putValue(T x, bool json) { putDouble(x, json); }
+};
+
 #endif
 
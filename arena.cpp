@@ -0,0 +1,254 @@
+#include "arena.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <mutex>
+#include <new>
+
+static const size_t kBaseAlign = 16;            // what operator new gives
+static const size_t kSmallest = 16;             // size class 0
+static const size_t kChunkBytes = 256 << 10;    // SizeClassPool carves these
+static const size_t kMaxCached = 1 << 20;       // per class and thread
+
+/******* operator new / delete *******/
+
+class NewDeleteResource : public MemoryResource {
+
+public:
+	void *allocate(size_t bytes, size_t align) {
+		if (align <= kBaseAlign) return ::operator new(bytes);
+		void *p = 0;
+		if (posix_memalign(&p, align, bytes) != 0) throw std::bad_alloc();
+		return p;
+	}
+
+	void deallocate(void *p, size_t, size_t align) {
+		if (align <= kBaseAlign) ::operator delete(p);
+		else ::free(p);
+	}
+};
+
+MemoryResource &newDeleteResource() {
+	static NewDeleteResource res;
+	return res;
+}
+
+/******* MonotonicArena *******/
+
+MonotonicArena::MonotonicArena(size_t firstChunk)
+	: cur(0), end(0), chunks(0), nextSize(std::max<size_t>(firstChunk, 256)), usedBytes(0),
+	  initial(0), initialSize(0) {}
+
+MonotonicArena::MonotonicArena(void *buffer, size_t size)
+	: cur(uintptr_t(buffer)), end(uintptr_t(buffer) + size), chunks(0),
+	  nextSize(std::max<size_t>(2 * size, 256)), usedBytes(0), initial(buffer), initialSize(size) {}
+
+MonotonicArena::~MonotonicArena() {
+	while (chunks) {
+		Chunk *next = chunks->next;
+		::operator delete(chunks);
+		chunks = next;
+	}
+}
+
+void *MonotonicArena::allocate(size_t bytes, size_t align) {
+
+	uintptr_t p = (cur + align - 1) & ~uintptr_t(align - 1);
+	if (!cur || p > end || end - p < bytes) {
+		grow(bytes + align);
+		p = (cur + align - 1) & ~uintptr_t(align - 1);
+	}
+	cur = p + bytes;
+	usedBytes += bytes;
+	return reinterpret_cast<void *>(p);
+}
+
+void MonotonicArena::grow(size_t bytes) {
+
+	size_t size = std::max(nextSize, bytes + sizeof(Chunk));
+	Chunk *c = static_cast<Chunk *>(::operator new(size));
+	c->next = chunks;
+	c->size = size;
+	chunks = c;
+
+	cur = uintptr_t(c + 1);
+	end = uintptr_t(c) + size;
+	nextSize = 2 * size;
+}
+
+void MonotonicArena::release() {
+
+	// The newest chunk is the largest, it likely fits the next round alone
+	if (chunks) {
+		Chunk *rest = chunks->next;
+		while (rest) {
+			Chunk *next = rest->next;
+			::operator delete(rest);
+			rest = next;
+		}
+		chunks->next = 0;
+		cur = uintptr_t(chunks + 1);
+		end = uintptr_t(chunks) + chunks->size;
+	} else {
+		cur = uintptr_t(initial);
+		end = uintptr_t(initial) + initialSize;
+	}
+	usedBytes = 0;
+}
+
+/******* SizeClassPool *******/
+
+struct SizeClassPool::Depot {
+	std::mutex lock;
+	Block *lists[kClasses];
+	Depot() {
+		for (int i = 0; i < kClasses; ++i) lists[i] = 0;
+	}
+};
+
+// Never destroyed, thread caches may still flush into it during exit
+SizeClassPool::Depot &SizeClassPool::depot() {
+	static Depot *d = new Depot();
+	return *d;
+}
+
+SizeClassPool &SizeClassPool::local() {
+	static SizeClassPool *pool = new SizeClassPool();
+	return *pool;
+}
+
+struct SizeClassPool::Cache {
+	Block *lists[kClasses];
+	size_t counts[kClasses];
+
+	Cache();
+	~Cache();
+	void refill(int cls);
+	void flush(int cls, size_t keep);
+};
+
+// Set once the thread's cache is destroyed, a plain bool outlives it
+static thread_local bool cacheGone = false;
+
+SizeClassPool::Cache *SizeClassPool::cache() {
+	if (cacheGone) return 0;
+	static thread_local Cache c;
+	return &c;
+}
+
+SizeClassPool::Cache::Cache() {
+	for (int i = 0; i < kClasses; ++i) {
+		lists[i] = 0;
+		counts[i] = 0;
+	}
+}
+
+SizeClassPool::Cache::~Cache() {
+	for (int i = 0; i < kClasses; ++i) flush(i, 0);
+	cacheGone = true;
+}
+
+// Smallest class of at least bytes, kClasses if there is none
+static int sizeClass(size_t bytes) {
+	if (bytes <= kSmallest) return 0;
+	return 64 - __builtin_clzll(bytes - 1) - 4;
+}
+
+void *SizeClassPool::allocate(size_t bytes, size_t align) {
+
+	int cls = sizeClass(bytes);
+	if (cls >= kClasses || align > kBaseAlign) return newDeleteResource().allocate(bytes, align);
+
+	// A whole class sized block, it may end up on any free list
+	Cache *c = cache();
+	if (!c) return ::operator new(kSmallest << cls);
+
+	if (!c->lists[cls]) c->refill(cls);
+	Block *b = c->lists[cls];
+	c->lists[cls] = b->next;
+	--c->counts[cls];
+	return b;
+}
+
+void SizeClassPool::deallocate(void *p, size_t bytes, size_t align) {
+
+	int cls = sizeClass(bytes);
+	if (cls >= kClasses || align > kBaseAlign) {
+		newDeleteResource().deallocate(p, bytes, align);
+		return;
+	}
+
+	Block *b = static_cast<Block *>(p);
+	Cache *c = cache();
+	if (!c) {
+		Depot &d = depot();
+		std::lock_guard<std::mutex> guard(d.lock);
+		b->next = d.lists[cls];
+		d.lists[cls] = b;
+		return;
+	}
+
+	b->next = c->lists[cls];
+	c->lists[cls] = b;
+	if (++c->counts[cls] * (kSmallest << cls) > kMaxCached) c->flush(cls, c->counts[cls] / 2);
+}
+
+// Up to half the cache limit from the depot, else a fresh chunk
+void SizeClassPool::Cache::refill(int cls) {
+
+	size_t size = kSmallest << cls;
+	Depot &d = depot();
+	{
+		std::lock_guard<std::mutex> guard(d.lock);
+		if (d.lists[cls]) {
+			size_t batch = std::max<size_t>(kMaxCached / 2 / size, 1), n = 1;
+			Block *last = d.lists[cls];
+			while (n < batch && last->next) {
+				last = last->next;
+				++n;
+			}
+			lists[cls] = d.lists[cls];
+			d.lists[cls] = last->next;
+			last->next = 0;
+			counts[cls] = n;
+			return;
+		}
+	}
+
+	// Never given back
+	size_t bytes = std::max(kChunkBytes, 16 * size);
+	char *chunk = static_cast<char *>(::operator new(bytes));
+	for (size_t off = bytes / size * size; off > 0;) {
+		off -= size;
+		Block *b = reinterpret_cast<Block *>(chunk + off);
+		b->next = lists[cls];
+		lists[cls] = b;
+		++counts[cls];
+	}
+}
+
+// Everything past the first keep blocks goes to the depot
+void SizeClassPool::Cache::flush(int cls, size_t keep) {
+
+	Block *give = lists[cls];
+	if (keep) {
+		Block *cut = lists[cls];
+		for (size_t i = 1; i < keep && cut; ++i) cut = cut->next;
+		if (!cut) return;
+		give = cut->next;
+		cut->next = 0;
+		counts[cls] = keep;
+	} else {
+		lists[cls] = 0;
+		counts[cls] = 0;
+	}
+	if (!give) return;
+
+	Block *tail = give;
+	while (tail->next) tail = tail->next;
+
+	Depot &d = depot();
+	std::lock_guard<std::mutex> guard(d.lock);
+	tail->next = d.lists[cls];
+	d.lists[cls] = give;
+}
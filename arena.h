@@ -0,0 +1,153 @@
+#ifndef EPI_ARENA_H
+#define EPI_ARENA_H
+
+/*
+Memory resources for the container-heavy Chapter 6 routines, so a
+call does not have to go to the global heap for every vector.
+
+	MonotonicArena arena;                       // bump pointer, freed at once
+	ResourceVector<int> primes = primer_array(N, arena);
+	...
+	arena.release();                            // keeps its largest chunk
+
+	ResourceVector<char> res = permute(v, p, SizeClassPool::local());
+
+MemoryResource is the std::pmr::memory_resource idea in C++11: the
+routines take one by reference, and ResourceAllocator<T> puts it
+behind the standard allocator interface, so the usual containers work
+on top (ResourceVector, ResourceDeque).
+
+MonotonicArena only moves a pointer forward, deallocate() does
+nothing. Memory comes back all at once with release() or the
+destructor. It can start in a buffer of the caller, e.g. on the
+stack, and grows by chunks that double in size.
+
+SizeClassPool keeps one free list per power-of-two size class, 16B to
+32KB, in every thread, so allocate() and deallocate() take no lock.
+Larger blocks go to operator new. There is only one pool: a block goes
+back to the cache of the thread that frees it, whichever thread took
+it, so a container may be handed to another thread and outlive the
+one that made it. When a thread's list grows past 1MB, and when the
+thread exits, its blocks go to a shared depot that other threads
+refill from. The pool never gives memory back to the system, like
+most malloc thread caches.
+*/
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <vector>
+
+class MemoryResource {
+
+public:
+	virtual ~MemoryResource() {}
+	virtual void *allocate(size_t bytes, size_t align) = 0;
+	virtual void deallocate(void *p, size_t bytes, size_t align) = 0;
+};
+
+// operator new and delete, what the containers use by default
+MemoryResource &newDeleteResource();
+
+class MonotonicArena : public MemoryResource {
+
+public:
+	explicit MonotonicArena(size_t firstChunk = 64 << 10);
+	MonotonicArena(void *buffer, size_t size);
+	~MonotonicArena();
+
+	void *allocate(size_t bytes, size_t align);
+	void deallocate(void *, size_t, size_t) {}
+
+	// Frees everything; the largest chunk stays for the next round
+	void release();
+
+	// Bytes handed out since the last release()
+	size_t used() const { return usedBytes; }
+
+private:
+	MonotonicArena(const MonotonicArena &);
+	MonotonicArena &operator=(const MonotonicArena &);
+
+	struct Chunk {
+		Chunk *next;
+		size_t size;
+	};
+
+	void grow(size_t bytes);
+
+	uintptr_t cur, end;
+	Chunk *chunks;            // newest, and largest, first
+	size_t nextSize, usedBytes;
+	void *initial;
+	size_t initialSize;
+};
+
+class SizeClassPool : public MemoryResource {
+
+public:
+	// The pool, it works from the calling thread's cache
+	static SizeClassPool &local();
+
+	void *allocate(size_t bytes, size_t align);
+	void deallocate(void *p, size_t bytes, size_t align);
+
+private:
+	SizeClassPool() {}
+	SizeClassPool(const SizeClassPool &);
+	SizeClassPool &operator=(const SizeClassPool &);
+
+	static const int kClasses = 12;             // 16B << 0 .. 16B << 11
+
+	struct Block {
+		Block *next;
+	};
+
+	struct Cache;
+	struct Depot;
+	static Depot &depot();
+	static Cache *cache();
+};
+
+template<class T>
+class ResourceAllocator {
+
+public:
+	typedef T value_type;
+
+	ResourceAllocator() : res(&newDeleteResource()) {}
+	ResourceAllocator(MemoryResource &res) : res(&res) {}
+	template<class U>
+	ResourceAllocator(const ResourceAllocator<U> &other) : res(other.resource()) {}
+
+	T *allocate(size_t n) {
+		return static_cast<T *>(res->allocate(n * sizeof(T), alignof(T)));
+	}
+
+	void deallocate(T *p, size_t n) {
+		res->deallocate(p, n * sizeof(T), alignof(T));
+	}
+
+	MemoryResource *resource() const { return res; }
+
+private:
+	MemoryResource *res;
+};
+
+template<class T, class U>
+bool operator==(const ResourceAllocator<T> &a, const ResourceAllocator<U> &b) {
+	return a.resource() == b.resource();
+}
+
+template<class T, class U>
+bool operator!=(const ResourceAllocator<T> &a, const ResourceAllocator<U> &b) {
+	return !(a == b);
+}
+
+template<class T>
+using ResourceVector = std::vector<T, ResourceAllocator<T> >;
+
+template<class T>
+using ResourceDeque = std::deque<T, ResourceAllocator<T> >;
+
+#endif
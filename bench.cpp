@@ -0,0 +1,801 @@
+#include "EPI.h"
+
+#include <atomic>
+#include <new>
+#include <cstdlib>
+
+/*
+Micro-benchmarks for the EPI routines, in the spirit of Google Benchmark
+but self-contained. Each benchmark is run over a list of input sizes,
+the iteration count grows until it runs for at least --min_time seconds,
+and the results go to stdout as JSON:
+
+	make bench
+	./EPI_bench --filter=parity --min_time=0.5
+	EPI_ISA=scalar ./EPI_bench --filter=kernel_
+
+For a size n one "op" is one call on n elements (array routines) or n
+calls on a pool of random inputs (the Chapter 5 word routines).
+*/
+
+/******* Allocation counting *******/
+
+// The parallel benches allocate from every pool thread at once
+static std::atomic<size_t> allocCount(0);
+static std::atomic<size_t> allocBytes(0);
+
+static size_t allocsSoFar() { return allocCount.load(std::memory_order_relaxed); }
+static size_t bytesSoFar() { return allocBytes.load(std::memory_order_relaxed); }
+
+/*
+Kept out of line as a pair: once GCC inlines the delete into a caller
+it sees free() on a pointer from operator new and warns under -Wall.
+*/
+__attribute__((noinline)) void *operator new(size_t size) {
+	allocCount.fetch_add(1, std::memory_order_relaxed);
+	allocBytes.fetch_add(size, std::memory_order_relaxed);
+	void *p = malloc(size ? size : 1);
+	if (!p) throw std::bad_alloc();
+	return p;
+}
+
+__attribute__((noinline)) void operator delete(void *p) noexcept {
+	free(p);
+}
+
+__attribute__((noinline)) void operator delete(void *p, size_t) noexcept {
+	free(p);
+}
+
+/******* Harness *******/
+
+// Keep the compiler from dropping a result we never read
+template<class T>
+inline void doNotOptimize(T const &value) {
+	asm volatile("" : : "r,m"(value) : "memory");
+}
+
+class BenchState {
+
+public:
+	BenchState(size_t range, size_t iterations)
+		: range(range), iterations(iterations), done(0),
+		  pausedNs(0), pausedAllocs(0), pausedBytes(0) {}
+
+	size_t range;
+
+	// while (state.keepRunning()) { ... one op ... }
+	bool keepRunning() {
+		if (done == 0) {
+			allocs0 = allocsSoFar();
+			bytes0 = bytesSoFar();
+			start = std::chrono::steady_clock::now();
+		}
+		if (done == iterations) {
+			stop = std::chrono::steady_clock::now();
+			allocs1 = allocsSoFar();
+			bytes1 = bytesSoFar();
+			return false;
+		}
+		++done;
+		return true;
+	}
+
+	// Exclude setup inside the loop (fresh copies of the input) from the op
+	void pauseTiming() {
+		pauseAt = std::chrono::steady_clock::now();
+		pauseAllocs = allocsSoFar();
+		pauseBytes = bytesSoFar();
+	}
+
+	void resumeTiming() {
+		pausedNs += std::chrono::duration<double, std::nano>(
+		                std::chrono::steady_clock::now() - pauseAt).count();
+		pausedAllocs += allocsSoFar() - pauseAllocs;
+		pausedBytes += bytesSoFar() - pauseBytes;
+	}
+
+	size_t iterationCount() const { return iterations; }
+
+	// At least a nanosecond, so a run below the clock's resolution (or
+	// one that was all pauses) still divides into a finite rate
+	double elapsedNs() const {
+		double ns = std::chrono::duration<double, std::nano>(stop - start).count() - pausedNs;
+		return std::max(ns, 1.0);
+	}
+
+	size_t allocs() const { return allocs1 - allocs0 - pausedAllocs; }
+	size_t bytes() const { return bytes1 - bytes0 - pausedBytes; }
+
+private:
+	size_t iterations, done;
+	std::chrono::steady_clock::time_point start, stop, pauseAt;
+	size_t allocs0, allocs1, bytes0, bytes1, pauseAllocs, pauseBytes;
+	double pausedNs;
+	size_t pausedAllocs, pausedBytes;
+};
+
+typedef void (*BenchFn)(BenchState &);
+
+struct Benchmark {
+	const char *name;
+	BenchFn fn;
+	std::vector<size_t> ranges;
+};
+
+static std::vector<Benchmark> &registry() {
+	static std::vector<Benchmark> benchmarks;
+	return benchmarks;
+}
+
+struct Registrar {
+	Registrar(const char *name, BenchFn fn, std::vector<size_t> ranges) {
+		Benchmark b = {name, fn, ranges};
+		registry().push_back(b);
+	}
+};
+
+#define BENCH(fn, ...) \
+	static void bench_##fn(BenchState &state); \
+	static Registrar registrar_##fn(#fn, bench_##fn, {__VA_ARGS__}); \
+	static void bench_##fn(BenchState &state)
+
+/******* Inputs *******/
+
+static std::vector<uint64_t> randomWords(size_t n, int bits = 64) {
+	std::mt19937_64 seed(n);
+	std::vector<uint64_t> v(n);
+	for (size_t i = 0; i < n; ++i) v[i] = bits == 64 ? seed() : seed() >> (64 - bits);
+	return v;
+}
+
+static std::vector<int> randomInts(size_t n, int lo, int hi) {
+	std::mt19937 seed(n);
+	std::uniform_int_distribution<int> dist(lo, hi);
+	std::vector<int> v(n);
+	for (size_t i = 0; i < n; ++i) v[i] = dist(seed);
+	return v;
+}
+
+/******* Chapter 5 *******/
+
+#define WORD_SIZES 1 << 10, 1 << 16
+
+BENCH(parityBruteForce, WORD_SIZES) {
+	std::vector<uint64_t> in = randomWords(state.range);
+	while (state.keepRunning()) {
+		for (size_t i = 0; i < in.size(); ++i) doNotOptimize(parityBruteForce(in[i]));
+	}
+}
+
+BENCH(parityOnlyViewSetBit, WORD_SIZES) {
+	std::vector<uint64_t> in = randomWords(state.range);
+	while (state.keepRunning()) {
+		for (size_t i = 0; i < in.size(); ++i) doNotOptimize(parityOnlyViewSetBit(in[i]));
+	}
+}
+
+BENCH(parityDivAndConq, WORD_SIZES) {
+	std::vector<uint64_t> in = randomWords(state.range);
+	while (state.keepRunning()) {
+		for (size_t i = 0; i < in.size(); ++i) doNotOptimize(parityDivAndConq(in[i]));
+	}
+}
+
+BENCH(swapBruteForce, WORD_SIZES) {
+	std::vector<uint64_t> in = randomWords(state.range, 31);
+	while (state.keepRunning()) {
+		for (size_t i = 0; i < in.size(); ++i) doNotOptimize(swapBruteForce(in[i], i & 15, 30 - (i & 15)));
+	}
+}
+
+BENCH(swapByMask, WORD_SIZES) {
+	std::vector<uint64_t> in = randomWords(state.range, 31);
+	while (state.keepRunning()) {
+		for (size_t i = 0; i < in.size(); ++i) doNotOptimize(swapByMask(in[i], i & 15, 30 - (i & 15)));
+	}
+}
+
+BENCH(revBits, WORD_SIZES) {
+	std::vector<uint64_t> in = randomWords(state.range);
+	while (state.keepRunning()) {
+		for (size_t i = 0; i < in.size(); ++i) doNotOptimize(revBits(in[i]));
+	}
+}
+
+BENCH(expoRecursion, WORD_SIZES) {
+	std::vector<int> in = randomInts(state.range, -64, 64);
+	while (state.keepRunning()) {
+		for (size_t i = 0; i < in.size(); ++i) doNotOptimize(expoRecursion(1.0001, in[i]));
+	}
+}
+
+BENCH(expoLoop, WORD_SIZES) {
+	std::vector<int> in = randomInts(state.range, -64, 64);
+	while (state.keepRunning()) {
+		for (size_t i = 0; i < in.size(); ++i) doNotOptimize(expoLoop(1.0001, in[i]));
+	}
+}
+
+// Small enough that revIntBruteForce does not overflow numPos
+#define REV_RANGE -200000000, 200000000
+
+BENCH(revIntBruteForce, WORD_SIZES) {
+	std::vector<int> in = randomInts(state.range, REV_RANGE);
+	while (state.keepRunning()) {
+		for (size_t i = 0; i < in.size(); ++i) doNotOptimize(revIntBruteForce(in[i]));
+	}
+}
+
+BENCH(revIntImprove, WORD_SIZES) {
+	std::vector<int> in = randomInts(state.range, REV_RANGE);
+	while (state.keepRunning()) {
+		for (size_t i = 0; i < in.size(); ++i) doNotOptimize(revIntImprove(in[i]));
+	}
+}
+
+BENCH(reverse_digits_batch, WORD_SIZES) {
+	std::vector<int> in = randomInts(state.range, REV_RANGE), out(state.range);
+	std::vector<unsigned char> ok(state.range);
+	while (state.keepRunning()) {
+		doNotOptimize(reverse_digits_batch(in.data(), out.data(), ok.data(), in.size()));
+	}
+}
+
+// Full-width int64 ids, up to 19 digits
+BENCH(reverse_digits_batch_i64, WORD_SIZES) {
+	std::vector<uint64_t> words = randomWords(state.range, 63);
+	std::vector<int64_t> in(words.begin(), words.end()), out(state.range);
+	std::vector<unsigned char> ok(state.range);
+	while (state.keepRunning()) {
+		doNotOptimize(reverse_digits_batch(in.data(), out.data(), ok.data(), in.size()));
+	}
+}
+
+BENCH(checkPalindrome, WORD_SIZES) {
+	std::vector<uint64_t> in = randomWords(state.range, 63);
+	while (state.keepRunning()) {
+		for (size_t i = 0; i < in.size(); ++i) doNotOptimize(checkPalindrome(in[i]));
+	}
+}
+
+BENCH(checkPalindromeImprove, WORD_SIZES) {
+	std::vector<uint64_t> in = randomWords(state.range, 63);
+	while (state.keepRunning()) {
+		for (size_t i = 0; i < in.size(); ++i) doNotOptimize(checkPalindromeImprove(in[i]));
+	}
+}
+
+BENCH(checkPalindromeDigits, WORD_SIZES) {
+	std::vector<uint64_t> in = randomWords(state.range, 63);
+	while (state.keepRunning()) {
+		for (size_t i = 0; i < in.size(); ++i) doNotOptimize(checkPalindromeDigits(in[i]));
+	}
+}
+
+BENCH(checkPalindromeBatch, WORD_SIZES) {
+	std::vector<uint64_t> in = randomWords(state.range, 63);
+	std::vector<unsigned char> res(state.range);
+	while (state.keepRunning()) {
+		checkPalindromeBatch(in.data(), in.size(), res.data());
+		doNotOptimize(res[0]);
+	}
+}
+
+/******* Chapter 6 *******/
+
+#define ARRAY_SIZES 1 << 10, 1 << 14, 1 << 18
+
+// For routines that change their input, time the call but not the copy
+#define MUTATING_LOOP(orig, v, call) \
+	std::vector<int> v; \
+	while (state.keepRunning()) { \
+		state.pauseTiming(); \
+		v = orig; \
+		state.resumeTiming(); \
+		doNotOptimize(call); \
+	}
+
+BENCH(insert_sort, 1 << 8, 1 << 10, 1 << 14) {
+	std::vector<int> orig = randomInts(state.range, 0, 1 << 30);
+	MUTATING_LOOP(orig, v, (insert_sort(v), v[0]))
+}
+
+BENCH(lambda_sort, ARRAY_SIZES) {
+	std::vector<int> orig = randomInts(state.range, 0, 1 << 30);
+	MUTATING_LOOP(orig, v, (lambda_sort(v), v[0]))
+}
+
+BENCH(rearrange, ARRAY_SIZES) {
+	std::vector<int> orig = randomInts(state.range, 0, 100);
+	MUTATING_LOOP(orig, v, (rearrange(v, v.size() / 2), v[0]))
+}
+
+BENCH(incre_arb_int, ARRAY_SIZES) {
+	std::vector<int> orig(state.range, 9);
+	MUTATING_LOOP(orig, v, (incre_arb_int(v), v[0]))
+}
+
+BENCH(mult_arb_int, 16, 256, 1024) {
+	std::vector<int> a = randomInts(state.range, 1, 9), b = randomInts(state.range, 1, 9);
+	while (state.keepRunning()) {
+		doNotOptimize(mult_arb_int(a, b).size());
+	}
+}
+
+BENCH(advancing, ARRAY_SIZES) {
+	std::vector<int> v = randomInts(state.range, 1, 4);
+	while (state.keepRunning()) {
+		doNotOptimize(advancing(v));
+	}
+}
+
+BENCH(del_dup_sorted, ARRAY_SIZES) {
+	std::vector<int> orig = randomInts(state.range, 0, state.range / 4);
+	std::sort(orig.begin(), orig.end());
+	MUTATING_LOOP(orig, v, del_dup_sorted(v))
+}
+
+BENCH(max_stock_diff, ARRAY_SIZES) {
+	std::vector<int> v = randomInts(state.range, 1, 1000);
+	while (state.keepRunning()) {
+		doNotOptimize(max_stock_diff(v));
+	}
+}
+
+BENCH(max_stock_two, ARRAY_SIZES) {
+	std::vector<int> v = randomInts(state.range, 1, 1000);
+	while (state.keepRunning()) {
+		doNotOptimize(max_stock_two(v));
+	}
+}
+
+BENCH(primer_array, 1 << 10, 1 << 16, 1 << 20) {
+	while (state.keepRunning()) {
+		doNotOptimize(primer_array(state.range).size());
+	}
+}
+
+// Random odd 64-bit values, most are rejected by trial division
+BENCH(is_prime_u64, 1 << 8, 1 << 12) {
+	std::vector<uint64_t> nums = randomWords(state.range);
+	for (size_t i = 0; i < nums.size(); ++i) nums[i] |= 1;
+	while (state.keepRunning()) {
+		for (size_t i = 0; i < nums.size(); ++i) doNotOptimize(is_prime_u64(nums[i]));
+	}
+}
+
+BENCH(is_prime_batch, 1 << 8, 1 << 12) {
+	std::vector<uint64_t> nums = randomWords(state.range);
+	for (size_t i = 0; i < nums.size(); ++i) nums[i] |= 1;
+	std::vector<unsigned char> res(nums.size());
+	while (state.keepRunning()) {
+		is_prime_batch(nums.data(), nums.size(), res.data());
+		doNotOptimize(res[0]);
+	}
+}
+
+static std::vector<int> randomPermutation(size_t n) {
+	std::vector<int> p(n);
+	for (size_t i = 0; i < n; ++i) p[i] = i;
+	std::shuffle(p.begin(), p.end(), std::mt19937(n));
+	return p;
+}
+
+BENCH(permute, ARRAY_SIZES) {
+	std::vector<char> v(state.range, 'a');
+	std::vector<int> p = randomPermutation(state.range);
+	while (state.keepRunning()) {
+		doNotOptimize(permute(v, p).size());
+	}
+}
+
+// permute_impv returns its result by value, that copy is part of the op
+BENCH(permute_impv, ARRAY_SIZES) {
+	std::vector<char> v(state.range, 'a');
+	std::vector<int> p = randomPermutation(state.range);
+	while (state.keepRunning()) {
+		doNotOptimize(permute_impv(v, p).size());
+	}
+}
+
+BENCH(next_permt, ARRAY_SIZES) {
+	std::vector<int> v = randomInts(state.range, 0, 1 << 30);
+	while (state.keepRunning()) {
+		doNotOptimize(next_permt(v).size());
+	}
+}
+
+BENCH(random_subset, ARRAY_SIZES) {
+	std::vector<int> v = randomInts(state.range, 0, 1 << 30);
+	while (state.keepRunning()) {
+		doNotOptimize(random_subset(v, v.size() / 8).size());
+	}
+}
+
+/******* Combinations of n features, k = n / 2, each scored by its weight sum *******/
+
+static std::vector<int> featureWeights(size_t n) {
+	return randomInts(n, 0, 1 << 20);
+}
+
+// The vector way: a 0/1 selection stepped by prev_permutation, indices copied out
+BENCH(combinations_vector, 16, 20, 24) {
+	size_t n = state.range;
+	std::vector<int> w = featureWeights(n);
+	while (state.keepRunning()) {
+		std::vector<char> sel(n, 0);
+		std::fill(sel.begin(), sel.begin() + n / 2, 1);
+		long best = 0;
+		do {
+			std::vector<int> idx;
+			for (size_t i = 0; i < n; ++i)
+				if (sel[i]) idx.push_back(i);
+			long score = 0;
+			for (int i : idx) score += w[i];
+			best = std::max(best, score);
+		} while (std::prev_permutation(sel.begin(), sel.end()));
+		doNotOptimize(best);
+	}
+}
+
+BENCH(combinations_gosper, 16, 20, 24) {
+	size_t n = state.range;
+	std::vector<int> w = featureWeights(n);
+	while (state.keepRunning()) {
+		long best = 0;
+		for_each_combination(n, n / 2, [&](uint64_t mask) {
+			long score = 0;
+			for (; mask; mask &= mask - 1) score += w[__builtin_ctzll(mask)];
+			best = std::max(best, score);
+		});
+		doNotOptimize(best);
+	}
+}
+
+// One element out and one in per step, the score follows in O(1)
+BENCH(combinations_revolving_door, 16, 20, 24) {
+	size_t n = state.range;
+	std::vector<int> w = featureWeights(n);
+	while (state.keepRunning()) {
+		RevolvingDoor door(n, n / 2);
+		long score = 0;
+		for (size_t i = 0; i < n / 2; ++i) score += w[i];
+		long best = score;
+		unsigned out, in;
+		while (door.next(out, in)) {
+			score += w[in] - w[out];
+			best = std::max(best, score);
+		}
+		doNotOptimize(best);
+	}
+}
+
+/******* BigInt decimal conversion, size is the number of digits *******/
+
+static std::string randomDecimal(size_t n) {
+	std::vector<int> digits = randomInts(n, 0, 9);
+	std::string s(n, '0');
+	for (size_t i = 0; i < n; ++i) s[i] = char('0' + digits[i]);
+	s[0] = '1';
+	return s;
+}
+
+BENCH(bigint_parse, 1 << 10, 1 << 14, 1 << 17) {
+	std::string s = randomDecimal(state.range);
+	BigInt x;
+	while (state.keepRunning()) {
+		doNotOptimize(BigInt::parse(s, x));
+	}
+}
+
+BENCH(bigint_toString, 1 << 10, 1 << 14, 1 << 17) {
+	BigInt x;
+	BigInt::parse(randomDecimal(state.range), x);
+	while (state.keepRunning()) {
+		doNotOptimize(x.toString().size());
+	}
+}
+
+BENCH(bigint_mul, 1 << 10, 1 << 14, 1 << 17) {
+	BigInt a, b;
+	BigInt::parse(randomDecimal(state.range), a);
+	BigInt::parse(randomDecimal(state.range), b);
+	while (state.keepRunning()) {
+		doNotOptimize((a * b).magnitude().size());
+	}
+}
+
+/******* BitVector rank/select over the prime sieve *******/
+
+// size is the number of bits, rank/select ops are 1024 random queries
+
+BENCH(bitvector_build, 1 << 16, 1 << 20, 1 << 24) {
+	std::vector<uint64_t> words = randomWords(state.range / 64);
+	while (state.keepRunning()) {
+		doNotOptimize(BitVector(words.data(), state.range).ones());
+	}
+}
+
+BENCH(bitvector_rank1, 1 << 16, 1 << 20, 1 << 24) {
+	BitVector primes = primer_bitvector(state.range);
+	std::vector<uint64_t> queries = randomWords(1024);
+	while (state.keepRunning()) {
+		for (size_t i = 0; i < queries.size(); ++i) doNotOptimize(primes.rank1(queries[i] % state.range));
+	}
+}
+
+BENCH(bitvector_select1, 1 << 16, 1 << 20, 1 << 24) {
+	BitVector primes = primer_bitvector(state.range);
+	std::vector<uint64_t> queries = randomWords(1024);
+	while (state.keepRunning()) {
+		for (size_t i = 0; i < queries.size(); ++i) doNotOptimize(primes.select1(queries[i] % primes.ones()));
+	}
+}
+
+/******* Parallel versions, EPI_THREADS=... sets the pool size *******/
+
+static Pool &benchPool() {
+	static Pool pool;
+	return pool;
+}
+
+BENCH(rearrange_parallel, ARRAY_SIZES) {
+	std::vector<int> orig = randomInts(state.range, 0, 100);
+	MUTATING_LOOP(orig, v, (rearrange_parallel(v, v.size() / 2, benchPool()), v[0]))
+}
+
+BENCH(insert_sort_parallel, 1 << 8, 1 << 10, 1 << 14) {
+	std::vector<int> orig = randomInts(state.range, 0, 1 << 30);
+	MUTATING_LOOP(orig, v, (insert_sort_parallel(v, benchPool()), v[0]))
+}
+
+BENCH(max_stock_diff_parallel, ARRAY_SIZES) {
+	std::vector<int> v = randomInts(state.range, 1, 1000);
+	while (state.keepRunning()) {
+		doNotOptimize(max_stock_diff_parallel(v, benchPool()));
+	}
+}
+
+BENCH(max_stock_two_parallel, ARRAY_SIZES) {
+	std::vector<int> v = randomInts(state.range, 1, 1000);
+	while (state.keepRunning()) {
+		doNotOptimize(max_stock_two_parallel(v, benchPool()));
+	}
+}
+
+BENCH(primer_array_parallel, 1 << 10, 1 << 16, 1 << 20) {
+	while (state.keepRunning()) {
+		doNotOptimize(primer_array_parallel(state.range, benchPool()).size());
+	}
+}
+
+BENCH(permute_parallel, ARRAY_SIZES) {
+	std::vector<char> v(state.range, 'a');
+	std::vector<int> p = randomPermutation(state.range);
+	while (state.keepRunning()) {
+		doNotOptimize(permute_parallel(v, p, benchPool()).size());
+	}
+}
+
+BENCH(combinations_parallel, 16, 20, 24) {
+	unsigned n = state.range;
+	std::vector<int> w = featureWeights(n);
+	while (state.keepRunning()) {
+		long best = benchPool().parallel_reduce(0, binomial(n, n / 2), 1 << 14, 0L,
+		[&](size_t b, size_t e) {
+			long best = 0;
+			for_each_combination(n, n / 2, b, e, [&](uint64_t mask) {
+				long score = 0;
+				for (; mask; mask &= mask - 1) score += w[__builtin_ctzll(mask)];
+				best = std::max(best, score);
+			});
+			return best;
+		},
+		[](long a, long b) { return std::max(a, b); });
+		doNotOptimize(best);
+	}
+}
+
+/******* Memory resources (arena.h), compare allocs_per_op with the heap versions *******/
+
+// The arena is reset every call, after the first round that is no heap at all
+BENCH(mult_arb_int_arena, 16, 256, 1024) {
+	std::vector<int> a = randomInts(state.range, 1, 9), b = randomInts(state.range, 1, 9);
+	MonotonicArena arena;
+	while (state.keepRunning()) {
+		doNotOptimize(mult_arb_int(a, b, arena).size());
+		arena.release();
+	}
+}
+
+BENCH(max_stock_two_arena, ARRAY_SIZES) {
+	std::vector<int> v = randomInts(state.range, 1, 1000);
+	MonotonicArena arena;
+	while (state.keepRunning()) {
+		doNotOptimize(max_stock_two(v, arena));
+		arena.release();
+	}
+}
+
+BENCH(primer_array_arena, 1 << 10, 1 << 16, 1 << 20) {
+	MonotonicArena arena;
+	while (state.keepRunning()) {
+		doNotOptimize(primer_array(state.range, arena).size());
+		arena.release();
+	}
+}
+
+BENCH(permute_pool, ARRAY_SIZES) {
+	std::vector<char> v(state.range, 'a');
+	std::vector<int> p = randomPermutation(state.range);
+	while (state.keepRunning()) {
+		doNotOptimize(permute(v, p, SizeClassPool::local()).size());
+	}
+}
+
+// Many small calls on every pool thread at once, where malloc contends
+static const size_t kManyCalls = 4096;
+
+BENCH(max_stock_two_many, 64, 1024) {
+	std::vector<int> v = randomInts(state.range, 1, 1000);
+	while (state.keepRunning()) {
+		benchPool().parallel_for(0, kManyCalls, 64, [&](size_t b, size_t e) {
+			for (size_t i = b; i < e; ++i) doNotOptimize(max_stock_two(v));
+		});
+	}
+}
+
+BENCH(max_stock_two_many_pool, 64, 1024) {
+	std::vector<int> v = randomInts(state.range, 1, 1000);
+	while (state.keepRunning()) {
+		benchPool().parallel_for(0, kManyCalls, 64, [&](size_t b, size_t e) {
+			for (size_t i = b; i < e; ++i) doNotOptimize(max_stock_two(v, SizeClassPool::local()));
+		});
+	}
+}
+
+/******* Pipelines (pipeline.h): filter -> del_dup_sorted -> max_stock_diff *******/
+
+#define CHAIN_SIZES 1 << 14, 1 << 18, 1 << 22
+
+static std::vector<int> sortedPrices(size_t n) {
+	std::vector<int> v = randomInts(n, -1000, n);
+	std::sort(v.begin(), v.end());
+	return v;
+}
+
+// One pass per routine over a copy, the way they are called today
+BENCH(chain_passes, CHAIN_SIZES) {
+	std::vector<int> orig = sortedPrices(state.range);
+	while (state.keepRunning()) {
+		std::vector<int> v = orig;
+		v.erase(std::remove_if(v.begin(), v.end(), [](int x) { return x <= 0; }), v.end());
+		if (!v.empty()) v.resize(del_dup_sorted(v));
+		doNotOptimize(max_stock_diff(v));
+	}
+}
+
+static void runChain(const std::vector<int> &v, bool threaded) {
+	unsigned best = 0;
+	Pipeline<int> p;
+	p.filter("positive", [](int x) { return x > 0; })
+	 .then(del_dup_sorted_stage<int>())
+	 .then(max_stock_diff_stage<int>(best));
+	p.run(v.data(), v.size(), threaded);
+	doNotOptimize(best);
+}
+
+BENCH(pipeline_chain, CHAIN_SIZES) {
+	std::vector<int> v = sortedPrices(state.range);
+	while (state.keepRunning()) runChain(v, true);
+}
+
+BENCH(pipeline_chain_serial, CHAIN_SIZES) {
+	std::vector<int> v = sortedPrices(state.range);
+	while (state.keepRunning()) runChain(v, false);
+}
+
+/******* Dispatched kernels (dispatch.h), EPI_ISA=... picks the tier *******/
+
+BENCH(kernel_parityBatch, WORD_SIZES) {
+	std::vector<uint64_t> in = randomWords(state.range);
+	std::vector<unsigned char> out(state.range);
+	while (state.keepRunning()) {
+		dispatch::active.parityBatch(in.data(), in.size(), out.data());
+		doNotOptimize(out[0]);
+	}
+}
+
+BENCH(kernel_reverseBitsBatch, WORD_SIZES) {
+	std::vector<uint64_t> in = randomWords(state.range), out(state.range);
+	while (state.keepRunning()) {
+		dispatch::active.reverseBitsBatch(in.data(), in.size(), out.data());
+		doNotOptimize(out[0]);
+	}
+}
+
+/******* Driver *******/
+
+static void writeString(BufferedWriter &out, const char *s) {
+	out.put('"');
+	out.put(s, strlen(s));
+	out.put('"');
+}
+
+int main(int argc, char **argv) {
+
+	double minTime = 0.1;
+	const char *filter = "";
+
+	for (int i = 1; i < argc; ++i) {
+		if (!strncmp(argv[i], "--min_time=", 11) && atof(argv[i] + 11) > 0) minTime = atof(argv[i] + 11);
+		else if (!strncmp(argv[i], "--filter=", 9)) filter = argv[i] + 9;
+		else {
+			fprintf(stderr, "usage: %s [--filter=substr] [--min_time=seconds > 0]\n", argv[0]);
+			return 1;
+		}
+	}
+
+	BufferedWriter out;
+	out.put("{\n  \"context\": {\"min_time\": ");
+	out.putDouble(minTime, true);
+	out.put(", \"optimized\": ");
+#ifdef __OPTIMIZE__
+	out.put("true");
+#else
+	out.put("false");
+#endif
+	out.put(", \"isa\": ");
+	writeString(out, dispatch::tierName(dispatch::active.tier));
+	out.put(", \"threads\": ");
+	out.putUInt(benchPool().size());
+	out.put("},\n  \"benchmarks\": [");
+
+	bool first = true;
+	for (size_t b = 0; b < registry().size(); ++b) {
+
+		const Benchmark &bench = registry()[b];
+		if (!strstr(bench.name, filter)) continue;
+
+		for (size_t r = 0; r < bench.ranges.size(); ++r) {
+
+			// Grow the iteration count until one run lasts minTime
+			size_t iterations = 1;
+			BenchState state(bench.ranges[r], iterations);
+			while (true) {
+				state = BenchState(bench.ranges[r], iterations);
+				bench.fn(state);
+				double ns = state.elapsedNs();
+				if (ns >= minTime * 1e9 || iterations >= (size_t(1) << 30)) break;
+				double grow = minTime * 1e9 * 1.4 / ns;
+				iterations = iterations * std::min(std::max(grow, 2.0), 10.0);
+			}
+
+			double perOp = state.elapsedNs() / state.iterationCount();
+
+			out.put(first ? "\n    {" : ",\n    {");
+			first = false;
+			out.put("\"name\": ");
+			writeString(out, bench.name);
+			out.put(", \"size\": ");
+			out.putUInt(bench.ranges[r]);
+			out.put(", \"iterations\": ");
+			out.putUInt(state.iterationCount());
+			out.put(", \"ns_per_op\": ");
+			out.putDouble(perOp, true);
+			out.put(", \"items_per_second\": ");
+			out.putDouble(bench.ranges[r] * 1e9 / perOp, true);
+			out.put(", \"allocs_per_op\": ");
+			out.putDouble(double(state.allocs()) / state.iterationCount(), true);
+			out.put(", \"bytes_allocated_per_op\": ");
+			out.putDouble(double(state.bytes()) / state.iterationCount(), true);
+			out.put('}');
+		}
+		// Keep partial results visible on long runs
+		out.flush();
+	}
+	out.put("\n  ]\n}\n");
+
+	return 0;
+}
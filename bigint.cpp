@@ -0,0 +1,534 @@
+#include "bigint.h"
+
+#include <algorithm>
+
+typedef std::vector<uint32_t> Limbs;
+
+static const uint32_t kChunk = 1000000000;      // 10^9, the first power
+static const size_t kChunkDigits = 9;
+static const size_t kKaratsubaLimbs = 32;       // schoolbook below this
+static const size_t kBaseLimbs = 32;            // convert chunk by chunk below this
+static const size_t kBaseDigits = 9 * 32;
+static const size_t kFirstBlock = 1 << 12;
+
+/*
+Stack-like scratch space. alloc() hands out limbs from the current
+block, release() gives back everything allocated since the matching
+mark(). Blocks never move, a request that does not fit goes to the
+next block, a new one twice the size if there is none.
+*/
+class Arena {
+
+public:
+	struct Mark {
+		size_t block, used;
+	};
+
+	Arena() : current(0), used(0) {}
+
+	uint32_t *alloc(size_t n) {
+		while (current < blocks.size() && used + n > blocks[current].size()) {
+			++current;
+			used = 0;
+		}
+		if (current == blocks.size()) {
+			size_t size = blocks.empty() ? kFirstBlock : 2 * blocks.back().size();
+			// Moving a vector keeps its buffer, so earlier blocks stay put
+			blocks.push_back(Limbs(std::max(size, n)));
+		}
+		uint32_t *p = blocks[current].data() + used;
+		used += n;
+		return p;
+	}
+
+	Mark mark() const {
+		Mark m = {current, used};
+		return m;
+	}
+
+	void release(Mark m) {
+		current = m.block;
+		used = m.used;
+	}
+
+private:
+	std::vector<Limbs> blocks;
+	size_t current, used;
+};
+
+struct ArenaScope {
+	Arena &arena;
+	Arena::Mark mark;
+	explicit ArenaScope(Arena &arena) : arena(arena), mark(arena.mark()) {}
+	~ArenaScope() { arena.release(mark); }
+};
+
+/******* Limb arrays *******/
+
+// x[0, xn) += y[0, yn), yn <= xn, returns the carry out of x
+static uint32_t addInto(uint32_t *x, size_t xn, const uint32_t *y, size_t yn) {
+	uint64_t carry = 0;
+	size_t i = 0;
+	for (; i < yn; ++i) {
+		carry += uint64_t(x[i]) + y[i];
+		x[i] = uint32_t(carry);
+		carry >>= 32;
+	}
+	for (; carry && i < xn; ++i) carry = ++x[i] == 0;
+	return uint32_t(carry);
+}
+
+// x[0, xn) -= y[0, yn), yn <= xn, returns the borrow out of x
+static uint32_t subFrom(uint32_t *x, size_t xn, const uint32_t *y, size_t yn) {
+	uint64_t borrow = 0;
+	size_t i = 0;
+	for (; i < yn; ++i) {
+		uint64_t t = uint64_t(x[i]) - y[i] - borrow;
+		x[i] = uint32_t(t);
+		borrow = (t >> 32) & 1;
+	}
+	for (; borrow && i < xn; ++i) {
+		borrow = x[i] == 0;
+		--x[i];
+	}
+	return uint32_t(borrow);
+}
+
+static size_t significant(const uint32_t *x, size_t n) {
+	while (n && x[n - 1] == 0) --n;
+	return n;
+}
+
+/*
+Schoolbook on 64-bit digits: two limbs of b per pass and two of a per
+step, so a pass is one 64 x 64 -> 128 multiply per limb pair. An odd
+limb at the top of a is a digit of its own, an odd last limb of b gets
+a 32-bit pass.
+*/
+static void mulBasecase(uint32_t *out, const uint32_t *a, size_t an, const uint32_t *b, size_t bn) {
+
+	typedef unsigned __int128 Wide;
+	std::fill(out, out + an + bn, 0);
+
+	size_t j = 0;
+	for (; j + 1 < bn; j += 2) {
+		uint64_t y = b[j] | uint64_t(b[j + 1]) << 32;
+		uint64_t carry = 0;
+		size_t i = 0;
+		for (; i + 1 < an; i += 2) {
+			uint64_t x = a[i] | uint64_t(a[i + 1]) << 32;
+			uint64_t o = out[i + j] | uint64_t(out[i + j + 1]) << 32;
+			// (2^64 - 1)^2 + 2 (2^64 - 1) still fits
+			Wide t = Wide(x) * y + o + carry;
+			out[i + j] = uint32_t(t);
+			out[i + j + 1] = uint32_t(uint64_t(t) >> 32);
+			carry = uint64_t(t >> 64);
+		}
+		if (i < an) {
+			// a[i] y + out[i + j] + carry < B^3, the top limb of this pass
+			Wide t = Wide(a[i]) * y + out[i + j] + carry;
+			out[i + j] = uint32_t(t);
+			out[i + j + 1] = uint32_t(uint64_t(t) >> 32);
+			out[i + j + 2] = uint32_t(t >> 64);
+		} else {
+			out[i + j] = uint32_t(carry);
+			out[i + j + 1] = uint32_t(carry >> 32);
+		}
+	}
+	if (j < bn) {
+		uint64_t carry = 0, y = b[j];
+		for (size_t i = 0; i < an; ++i) {
+			uint64_t t = a[i] * y + out[i + j] + carry;
+			out[i + j] = uint32_t(t);
+			carry = t >> 32;
+		}
+		out[an + j] = uint32_t(carry);
+	}
+}
+
+/*
+out[0, an + bn) = a * b. Karatsuba: with a = a1 B^h + a0 and
+b = b1 B^h + b0,
+
+	a * b = z2 B^2h + ((a0 + a1)(b0 + b1) - z2 - z0) B^h + z0
+
+z0 = a0 b0 and z2 = a1 b1 go straight into out, only the middle
+product needs scratch. When b is at most half of a, multiply b by
+each b-sized slice of a instead.
+*/
+static void mulLimbs(uint32_t *out, const uint32_t *a, size_t an, const uint32_t *b, size_t bn, Arena &arena) {
+
+	if (an < bn) {
+		std::swap(a, b);
+		std::swap(an, bn);
+	}
+	if (bn == 0) {
+		std::fill(out, out + an, 0);
+		return;
+	}
+	if (bn < kKaratsubaLimbs) {
+		mulBasecase(out, a, an, b, bn);
+		return;
+	}
+
+	ArenaScope scope(arena);
+	size_t h = (an + 1) / 2;
+
+	if (bn <= h) {
+		std::fill(out, out + an + bn, 0);
+		uint32_t *t = arena.alloc(2 * bn);
+		for (size_t i = 0; i < an; i += bn) {
+			size_t len = std::min(bn, an - i);
+			mulLimbs(t, a + i, len, b, bn, arena);
+			addInto(out + i, an + bn - i, t, len + bn);
+		}
+		return;
+	}
+
+	mulLimbs(out, a, h, b, h, arena);
+	mulLimbs(out + 2 * h, a + h, an - h, b + h, bn - h, arena);
+
+	uint32_t *sa = arena.alloc(h + 1);
+	uint32_t *sb = arena.alloc(h + 1);
+	std::copy(a, a + h, sa);
+	std::copy(b, b + h, sb);
+	sa[h] = addInto(sa, h, a + h, an - h);
+	sb[h] = addInto(sb, h, b + h, bn - h);
+	size_t san = significant(sa, h + 1), sbn = significant(sb, h + 1);
+
+	uint32_t *mid = arena.alloc(2 * h + 2);
+	mulLimbs(mid, sa, san, sb, sbn, arena);
+	std::fill(mid + san + sbn, mid + 2 * h + 2, 0);
+	subFrom(mid, 2 * h + 2, out, 2 * h);
+	subFrom(mid, 2 * h + 2, out + 2 * h, an + bn - 2 * h);
+
+	addInto(out + h, an + bn - h, mid, significant(mid, 2 * h + 2));
+}
+
+/******* Limb vectors, no leading zero limbs *******/
+
+static void trim(Limbs &x) {
+	while (!x.empty() && x.back() == 0) x.pop_back();
+}
+
+static int compare(const Limbs &a, const Limbs &b) {
+	if (a.size() != b.size()) return a.size() < b.size() ? -1 : 1;
+	for (size_t i = a.size(); i-- > 0;) {
+		if (a[i] != b[i]) return a[i] < b[i] ? -1 : 1;
+	}
+	return 0;
+}
+
+static Limbs mul(const Limbs &a, const Limbs &b, Arena &arena) {
+	if (a.empty() || b.empty()) return Limbs();
+	Limbs out(a.size() + b.size());
+	mulLimbs(out.data(), a.data(), a.size(), b.data(), b.size(), arena);
+	trim(out);
+	return out;
+}
+
+static void add(Limbs &x, const Limbs &y) {
+	if (x.size() < y.size()) x.resize(y.size(), 0);
+	x.push_back(0);
+	addInto(x.data(), x.size(), y.data(), y.size());
+	trim(x);
+}
+
+// x -= y, x >= y
+static void sub(Limbs &x, const Limbs &y) {
+	subFrom(x.data(), x.size(), y.data(), y.size());
+	trim(x);
+}
+
+// x * B^k and x / B^k, B = 2^32
+static Limbs shiftUp(const Limbs &x, size_t k) {
+	if (x.empty()) return x;
+	Limbs out(k, 0);
+	out.insert(out.end(), x.begin(), x.end());
+	return out;
+}
+
+static Limbs shiftDown(const Limbs &x, size_t k) {
+	return k < x.size() ? Limbs(x.begin() + k, x.end()) : Limbs();
+}
+
+// x = x * m + a
+static void mulAddSmall(Limbs &x, uint32_t m, uint32_t a) {
+	uint64_t carry = a;
+	for (size_t i = 0; i < x.size(); ++i) {
+		carry += uint64_t(x[i]) * m;
+		x[i] = uint32_t(carry);
+		carry >>= 32;
+	}
+	if (carry) x.push_back(uint32_t(carry));
+}
+
+// x = x / d, returns x % d
+static uint32_t divSmall(Limbs &x, uint32_t d) {
+	uint64_t rem = 0;
+	for (size_t i = x.size(); i-- > 0;) {
+		rem = (rem << 32) | x[i];
+		x[i] = uint32_t(rem / d);
+		rem %= d;
+	}
+	trim(x);
+	return uint32_t(rem);
+}
+
+/******* Reciprocals and division by a power of 10 *******/
+
+/*
+floor(B^(2m) / d) for an m-limb d, bit by bit as in long division.
+Only for the few limbs at the bottom of reciprocal().
+*/
+static Limbs reciprocalBasecase(const Limbs &d) {
+
+	size_t m = d.size();
+	Limbs q(2 * m + 1, 0), rem;
+	for (size_t bit = 64 * m + 1; bit-- > 0;) {
+		// rem = 2 rem + (bit of B^(2m)), only the top bit is set
+		rem.push_back(0);
+		for (size_t i = rem.size() - 1; i > 0; --i) rem[i] = (rem[i] << 1) | (rem[i - 1] >> 31);
+		rem[0] = (rem[0] << 1) | (bit == 64 * m ? 1 : 0);
+		trim(rem);
+		if (compare(rem, d) >= 0) {
+			sub(rem, d);
+			q[bit >> 5] |= 1U << (bit & 31);
+		}
+	}
+	trim(q);
+	return q;
+}
+
+/*
+floor(B^(2m) / d) for an m-limb d. Start from the reciprocal of the
+top h = ceil(m / 2) + 2 limbs of d, which is good to about m / 2 limbs,
+and do one Newton step r += r (B^(2m) - r d) / B^(2m) to double that.
+
+r is that half-size reciprocal shifted up, so both products are taken
+with the half only, and of e = |B^(2m) - r d| only the top limbs matter:
+dropping the low m - 1 costs less than a unit of the step. r d is then
+updated instead of multiplied again, and what is left is a unit or two,
+fixed by comparing r d with B^(2m).
+*/
+static Limbs reciprocal(const Limbs &d, Arena &arena) {
+
+	size_t m = d.size();
+	if (m <= 8) return reciprocalBasecase(d);
+
+	size_t h = (m + 1) / 2 + 2;
+	Limbs half = reciprocal(Limbs(d.end() - h, d.end()), arena);
+	Limbs r = shiftUp(half, m - h);
+	Limbs rd = shiftUp(mul(half, d, arena), m - h);
+	Limbs unit = shiftUp(Limbs(1, 1), 2 * m);
+
+	bool low = compare(rd, unit) <= 0;
+	Limbs e = low ? unit : rd;
+	sub(e, low ? rd : unit);
+	Limbs step = shiftDown(mul(half, shiftDown(e, m - 1), arena), h + 1);
+	if (low) {
+		add(r, step);
+		add(rd, mul(step, d, arena));
+	} else {
+		sub(r, step);
+		sub(rd, mul(step, d, arena));
+	}
+
+	const Limbs one(1, 1);
+	while (compare(rd, unit) > 0) {
+		sub(r, one);
+		sub(rd, d);
+	}
+	for (;;) {
+		Limbs next = rd;
+		add(next, d);
+		if (compare(next, unit) > 0) break;
+		rd.swap(next);
+		add(r, one);
+	}
+	return r;
+}
+
+// 10^(9 * 2^k), and its reciprocal once a division needs it
+struct Power {
+	Limbs value, inverse;
+};
+
+static void buildPowers(std::vector<Power> &pow, size_t count, Arena &arena) {
+	if (pow.empty()) {
+		pow.push_back(Power());
+		pow[0].value.push_back(kChunk);
+	}
+	while (pow.size() < count) {
+		Power next;
+		next.value = mul(pow.back().value, pow.back().value, arena);
+		pow.push_back(next);
+	}
+}
+
+/*
+q = x / p, r = x % p for x < p^2, Barrett style: with m limbs in p and
+R = floor(B^(2m) / p), floor(floor(x / B^(m - 1)) R / B^(m + 1)) is
+at most two below the quotient.
+*/
+static void divmod(const Limbs &x, Power &p, Limbs &q, Limbs &r, Arena &arena) {
+
+	size_t m = p.value.size();
+	if (p.inverse.empty()) p.inverse = reciprocal(p.value, arena);
+
+	q = shiftDown(mul(shiftDown(x, m - 1), p.inverse, arena), m + 1);
+	r = x;
+	sub(r, mul(q, p.value, arena));
+
+	const Limbs one(1, 1);
+	while (compare(r, p.value) >= 0) {
+		sub(r, p.value);
+		add(q, one);
+	}
+}
+
+/******* Decimal to binary *******/
+
+// len digits, one 10^9 chunk at a time: x = x * 10^9 + chunk
+static Limbs parseChunks(const char *s, size_t len) {
+
+	Limbs x;
+	size_t n = len % kChunkDigits ? len % kChunkDigits : kChunkDigits;
+	for (size_t i = 0; i < len; i += n, n = kChunkDigits) {
+		uint32_t chunk = 0, scale = 1;
+		for (size_t j = i; j < i + n; ++j) {
+			chunk = chunk * 10 + (s[j] - '0');
+			scale *= 10;
+		}
+		mulAddSmall(x, scale, chunk);
+	}
+	trim(x);
+	return x;
+}
+
+// The low 9 * 2^k digits with k as large as it goes, then high * 10^(9 * 2^k) + low
+static Limbs parseRange(const char *s, size_t len, std::vector<Power> &pow, Arena &arena) {
+
+	if (len <= kBaseDigits) return parseChunks(s, len);
+
+	size_t k = 0;
+	while ((kChunkDigits << (k + 1)) < len) ++k;
+	size_t low = kChunkDigits << k;
+
+	Limbs x = mul(parseRange(s, len - low, pow, arena), pow[k].value, arena);
+	add(x, parseRange(s + len - low, low, pow, arena));
+	return x;
+}
+
+/******* Binary to decimal *******/
+
+// Exactly width digits of x, zero padded, 10^9 at a time from the right
+static void printChunks(Limbs x, char *out, size_t width) {
+
+	size_t end = width;
+	while (end) {
+		uint32_t chunk = divSmall(x, kChunk);
+		for (size_t i = 0; i < kChunkDigits && end; ++i) {
+			out[--end] = char('0' + chunk % 10);
+			chunk /= 10;
+		}
+	}
+}
+
+// Exactly 9 * 2^k digits of x < 10^(9 * 2^k)
+static void printPadded(const Limbs &x, size_t k, char *out, std::vector<Power> &pow, Arena &arena) {
+
+	if (x.size() <= kBaseLimbs) {
+		printChunks(x, out, kChunkDigits << k);
+		return;
+	}
+	Limbs q, r;
+	divmod(x, pow[k - 1], q, r, arena);
+	printPadded(q, k - 1, out, pow, arena);
+	printPadded(r, k - 1, out + (kChunkDigits << (k - 1)), pow, arena);
+}
+
+static void printRange(const Limbs &x, std::string &out, std::vector<Power> &pow, Arena &arena) {
+
+	if (x.size() <= kBaseLimbs) {
+		// A limb is under 10 digits
+		std::string buf(10 * x.size() + 1, '0');
+		printChunks(x, &buf[0], buf.size());
+		size_t first = std::min(buf.find_first_not_of('0'), buf.size() - 1);
+		out.append(buf, first, std::string::npos);
+		return;
+	}
+
+	// Largest power not above x, so x < 10^(9 * 2^(k + 1)) = p^2
+	size_t k = 0;
+	buildPowers(pow, 2, arena);
+	while (compare(pow[k + 1].value, x) <= 0) {
+		++k;
+		buildPowers(pow, k + 2, arena);
+	}
+
+	Limbs q, r;
+	divmod(x, pow[k], q, r, arena);
+	printRange(q, out, pow, arena);
+
+	size_t at = out.size();
+	out.resize(at + (kChunkDigits << k));
+	printPadded(r, k, &out[at], pow, arena);
+}
+
+/******* BigInt *******/
+
+BigInt::BigInt(int64_t value) : negative(value < 0) {
+	uint64_t mag = negative ? 0 - uint64_t(value) : uint64_t(value);
+	limbs.push_back(uint32_t(mag));
+	limbs.push_back(uint32_t(mag >> 32));
+	trim(limbs);
+}
+
+bool BigInt::parse(const char *s, size_t len, BigInt &out) {
+
+	bool negative = len && s[0] == '-';
+	if (negative) {
+		++s;
+		--len;
+	}
+	if (!len) return false;
+	for (size_t i = 0; i < len; ++i) {
+		if (s[i] < '0' || s[i] > '9') return false;
+	}
+
+	// Leading zeros would only unbalance the split
+	while (len > 1 && *s == '0') {
+		++s;
+		--len;
+	}
+
+	Arena arena;
+	std::vector<Power> pow;
+	size_t levels = 1;
+	while ((kChunkDigits << levels) < len) ++levels;
+	buildPowers(pow, levels, arena);
+
+	out.limbs = parseRange(s, len, pow, arena);
+	out.negative = negative && !out.limbs.empty();
+	return true;
+}
+
+std::string BigInt::toString() const {
+
+	std::string out;
+	if (negative) out.push_back('-');
+
+	Arena arena;
+	std::vector<Power> pow;
+	printRange(limbs, out, pow, arena);
+	return out;
+}
+
+BigInt BigInt::operator*(const BigInt &other) const {
+	Arena arena;
+	BigInt res;
+	res.limbs = mul(limbs, other.limbs, arena);
+	res.negative = negative != other.negative && !res.limbs.empty();
+	return res;
+}
@@ -0,0 +1,59 @@
+#ifndef EPI_BIGINT_H
+#define EPI_BIGINT_H
+
+/*
+Arbitrary-precision integer in binary limbs, with conversion from and
+to decimal text. 6.2 and 6.3 work one decimal digit per int; this is
+for numbers too long for that.
+
+	BigInt a, b;
+	BigInt::parse("-123456789012345678901234567890", a);
+	b = a * a;
+	std::string s = b.toString();
+
+Both conversions are divide and conquer over the powers
+10^(9 * 2^k), k = 0, 1, 2, ..., each the square of the one before.
+parse() splits the text at 9 * 2^k digits and combines the halves as
+high * 10^(9 * 2^k) + low. toString() divides by the same powers,
+using a Newton reciprocal computed once per power, so every division
+is two multiplications. With Karatsuba multiplication both are
+O(M(n) log n) instead of the O(n^2) of the digit-by-digit way.
+
+Temporaries come from a stack-like scratch arena owned by each call,
+so the recursion does not hit the heap for every product.
+*/
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+class BigInt {
+
+public:
+	BigInt() : negative(false) {}
+	explicit BigInt(int64_t value);
+
+	// Decimal text with an optional leading '-', false if it is not one
+	static bool parse(const char *s, size_t len, BigInt &out);
+	static bool parse(const std::string &s, BigInt &out) { return parse(s.data(), s.size(), out); }
+
+	std::string toString() const;
+
+	bool isZero() const { return limbs.empty(); }
+	bool operator==(const BigInt &other) const {
+		return negative == other.negative && limbs == other.limbs;
+	}
+	bool operator!=(const BigInt &other) const { return !(*this == other); }
+
+	BigInt operator*(const BigInt &other) const;
+
+	// Little-endian base 2^32 magnitude, no leading zero limbs
+	const std::vector<uint32_t> &magnitude() const { return limbs; }
+
+private:
+	bool negative;
+	std::vector<uint32_t> limbs;
+};
+
+#endif
@@ -0,0 +1,241 @@
+#include "bitvector.h"
+#include "dispatch.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <utility>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static const uint64_t kMagic = 0x3156544942495045ULL;   // "EPIBITV1"
+static const size_t kHeaderWords = 6;
+static const size_t kOnesPerSample = 512;
+
+BitVector::BitVector()
+	: numBits(0), numWords(0), numBlocks(0), numOnes(0), numSamples(0),
+	  bits(0), counts(0), samples(0), mapped(0), mappedSize(0) {
+	build();
+}
+
+BitVector::BitVector(const uint64_t *words, size_t numBits)
+	: numBits(numBits), numWords((numBits + 63) / 64), numBlocks(0), numOnes(0), numSamples(0),
+	  bits(0), counts(0), samples(0), mapped(0), mappedSize(0) {
+
+	// Whole blocks plus one, so rank1(size()) never reads past the end
+	ownBits.assign((numWords / 8 + 1) * 8, 0);
+	if (numWords) {
+		memcpy(ownBits.data(), words, numWords * sizeof(uint64_t));
+		if (numBits & 63) ownBits[numWords - 1] &= (1ULL << (numBits & 63)) - 1;
+	}
+	build();
+}
+
+BitVector::BitVector(std::vector<uint64_t> &&words, size_t numBits)
+	: numBits(numBits), numWords((numBits + 63) / 64), numBlocks(0), numOnes(0), numSamples(0),
+	  bits(0), counts(0), samples(0), mapped(0), mappedSize(0) {
+
+	// Same layout as the copying constructor, without the copy
+	ownBits.swap(words);
+	ownBits.resize((numWords / 8 + 1) * 8);
+	if (numBits & 63) ownBits[numWords - 1] &= (1ULL << (numBits & 63)) - 1;
+	std::fill(ownBits.begin() + numWords, ownBits.end(), 0);
+	build();
+}
+
+BitVector::~BitVector() {
+	release();
+}
+
+BitVector::BitVector(BitVector &&other) : mapped(0) {
+	*this = std::move(other);
+}
+
+BitVector &BitVector::operator=(BitVector &&other) {
+	if (this == &other) return *this;
+	release();
+
+	numBits = other.numBits;
+	numWords = other.numWords;
+	numBlocks = other.numBlocks;
+	numOnes = other.numOnes;
+	numSamples = other.numSamples;
+	bits = other.bits;
+	counts = other.counts;
+	samples = other.samples;
+	// Moving a vector keeps its buffer, so the pointers stay valid
+	ownBits.swap(other.ownBits);
+	ownCounts.swap(other.ownCounts);
+	ownSamples.swap(other.ownSamples);
+	mapped = other.mapped;
+	mappedSize = other.mappedSize;
+
+	other.mapped = 0;
+	other.mappedSize = 0;
+	other.ownBits.clear();
+	other.ownCounts.clear();
+	other.ownSamples.clear();
+	other.numBits = other.numWords = other.numOnes = other.numSamples = 0;
+	other.build();
+	return *this;
+}
+
+void BitVector::release() {
+	if (mapped) munmap(mapped, mappedSize);
+	mapped = 0;
+	mappedSize = 0;
+}
+
+/*
+One pass over the words: per-word popcounts come from the dispatched
+kernel, eight of them at a time become a block's count pair, and a
+select sample is taken each time the running count crosses 512.
+*/
+void BitVector::build() {
+
+	if (ownBits.empty()) ownBits.assign(8, 0);
+	numBlocks = ownBits.size() / 8;
+	ownCounts.assign(2 * numBlocks, 0);
+	ownSamples.clear();
+
+	unsigned char pop[8 * 512];
+	uint64_t total = 0;
+
+	for (size_t first = 0; first < numBlocks; first += 512) {
+
+		size_t blocks = std::min<size_t>(512, numBlocks - first);
+		dispatch::active.popcountWords(&ownBits[first * 8], blocks * 8, pop);
+
+		for (size_t b = 0; b < blocks; ++b) {
+			uint64_t rel = 0, inBlock = 0;
+			for (size_t w = 0; w < 8; ++w) {
+				if (w) rel |= inBlock << (9 * (w - 1));
+				inBlock += pop[b * 8 + w];
+			}
+			ownCounts[2 * (first + b)] = total;
+			ownCounts[2 * (first + b) + 1] = rel;
+
+			// Every block that holds the (512 * j)-th one
+			while (ownSamples.size() * kOnesPerSample < total + inBlock) {
+				ownSamples.push_back(first + b);
+			}
+			total += inBlock;
+		}
+	}
+
+	numOnes = total;
+	numSamples = ownSamples.size();
+	bits = ownBits.data();
+	counts = ownCounts.data();
+	samples = ownSamples.empty() ? 0 : ownSamples.data();
+}
+
+/*
+The k-th one lies between the blocks of samples j and j + 1, j = k / 512.
+When the ones are sparse that can be many blocks, so binary search
+their counts; the in-word step is pdep where the CPU has BMI2.
+*/
+size_t BitVector::select1(size_t k) const {
+
+	if (k >= numOnes) return numBits;
+
+	size_t j = k / kOnesPerSample;
+	size_t lo = samples[j], hi = j + 1 < numSamples ? samples[j + 1] : numBlocks - 1;
+
+	// Last block in [lo, hi] with counts <= k
+	while (lo < hi) {
+		size_t mid = lo + (hi - lo + 1) / 2;
+		if (counts[2 * mid] <= k) lo = mid;
+		else hi = mid - 1;
+	}
+	size_t block = lo;
+
+	size_t left = k - counts[2 * block];
+	uint64_t rel = counts[2 * block + 1];
+
+	size_t sub = 0;
+	while (sub < 7 && ((rel >> (9 * sub)) & 0x1FF) <= left) ++sub;
+	if (sub) left -= (rel >> (9 * (sub - 1))) & 0x1FF;
+
+	size_t word = block * 8 + sub;
+	return word * 64 + dispatch::active.selectInWord(bits[word], left);
+}
+
+bool BitVector::save(const char *path) const {
+
+	FILE *f = fopen(path, "wb");
+	if (!f) return false;
+
+	uint64_t header[kHeaderWords] = {kMagic, numBits, numWords, numBlocks, numOnes, numSamples};
+	bool ok = fwrite(header, sizeof header, 1, f) == 1 &&
+	          fwrite(bits, sizeof(uint64_t), numBlocks * 8, f) == numBlocks * 8 &&
+	          fwrite(counts, sizeof(uint64_t), numBlocks * 2, f) == numBlocks * 2 &&
+	          (!numSamples || fwrite(samples, sizeof(uint64_t), numSamples, f) == numSamples);
+
+	return fclose(f) == 0 && ok;
+}
+
+/*
+A truncated or foreign file must not lead select1 or rank1 off the
+end of the mapping: the sizes have to be the ones build() makes and
+fill the file exactly, and every sample has to name a block in order.
+*/
+static bool validImage(const uint64_t *header, size_t fileWords) {
+
+	uint64_t numBits = header[1], numWords = header[2], numBlocks = header[3];
+	uint64_t numOnes = header[4], numSamples = header[5];
+
+	if (header[0] != kMagic || numWords != numBits / 64 + (numBits % 64 != 0)) return false;
+	if (numBlocks != numWords / 8 + 1 || numOnes > numBits) return false;
+	if (numSamples != (numOnes + kOnesPerSample - 1) / kOnesPerSample) return false;
+	if (numBlocks > (fileWords - kHeaderWords) / 10) return false;
+	if (kHeaderWords + numBlocks * 10 + numSamples != fileWords) return false;
+
+	const uint64_t *samples = header + kHeaderWords + numBlocks * 10;
+	for (size_t j = 0; j < numSamples; ++j) {
+		if (samples[j] >= numBlocks || (j && samples[j] < samples[j - 1])) return false;
+	}
+	return true;
+}
+
+bool BitVector::map(const char *path, BitVector &out) {
+
+	int fd = open(path, O_RDONLY);
+	if (fd < 0) return false;
+
+	struct stat st;
+	if (fstat(fd, &st) != 0 || size_t(st.st_size) < kHeaderWords * sizeof(uint64_t)) {
+		close(fd);
+		return false;
+	}
+
+	void *base = mmap(0, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (base == MAP_FAILED) return false;
+
+	const uint64_t *header = static_cast<const uint64_t *>(base);
+	if (!validImage(header, st.st_size / sizeof(uint64_t)) || st.st_size % sizeof(uint64_t)) {
+		munmap(base, st.st_size);
+		return false;
+	}
+
+	BitVector view;
+	view.numBits = header[1];
+	view.numWords = header[2];
+	view.numBlocks = header[3];
+	view.numOnes = header[4];
+	view.numSamples = header[5];
+	view.bits = header + kHeaderWords;
+	view.counts = view.bits + view.numBlocks * 8;
+	view.samples = view.counts + view.numBlocks * 2;
+	view.ownBits.clear();
+	view.ownCounts.clear();
+	view.ownSamples.clear();
+	view.mapped = base;
+	view.mappedSize = st.st_size;
+
+	out = std::move(view);
+	return true;
+}
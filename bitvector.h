@@ -0,0 +1,83 @@
+#ifndef EPI_BITVECTOR_H
+#define EPI_BITVECTOR_H
+
+/*
+Static bit vector with rank and select, built on the 5.1 popcount ideas.
+
+	BitVector bv(words, numBits);
+	bv.rank1(i);       // number of 1s in [0, i)
+	bv.select1(k);     // position of the k-th 1 (0-based)
+
+Layout is rank9 (Vigna, "Broadword Implementation of Rank/Select
+Queries"): every 512-bit block has two interleaved words of counts,
+the number of 1s before the block and seven 9-bit counts of 1s before
+each of its words. rank1 is two loads and a popcount. select1 jumps
+to a sampled block (one sample every 512 ones), binary searches the
+block counts up to the next sample, then picks the word and the bit
+in it (pdep on CPUs with BMI2, through dispatch.h).
+
+save() writes one flat, 8-byte aligned image; map() opens it read-only
+with mmap, so a saved index is usable without being read or rebuilt.
+*/
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+class BitVector {
+
+public:
+	BitVector();
+	// Copies numBits bits from words, bits past numBits are ignored
+	BitVector(const uint64_t *words, size_t numBits);
+	// Takes the words over instead of copying them
+	BitVector(std::vector<uint64_t> &&words, size_t numBits);
+	~BitVector();
+
+	BitVector(BitVector &&other);
+	BitVector &operator=(BitVector &&other);
+
+	size_t size() const { return numBits; }
+	size_t ones() const { return numOnes; }
+
+	bool get(size_t i) const { return (bits[i >> 6] >> (i & 63)) & 1; }
+
+	// Number of 1s in [0, i), i <= size()
+	size_t rank1(size_t i) const {
+		size_t word = i >> 6, block = word >> 3, sub = word & 7;
+		const uint64_t *c = counts + 2 * block;
+		size_t r = c[0];
+		if (sub) r += (c[1] >> (9 * (sub - 1))) & 0x1FF;
+		if (i & 63) r += __builtin_popcountll(bits[word] << (64 - (i & 63)));
+		return r;
+	}
+
+	size_t rank0(size_t i) const { return i - rank1(i); }
+
+	// Position of the k-th 1 counting from 0, size() if k >= ones()
+	size_t select1(size_t k) const;
+
+	// Write the index to path / open a saved one with mmap
+	bool save(const char *path) const;
+	static bool map(const char *path, BitVector &out);
+
+private:
+	BitVector(const BitVector &);
+	BitVector &operator=(const BitVector &);
+
+	void build();
+	void release();
+
+	size_t numBits, numWords, numBlocks, numOnes, numSamples;
+
+	// Point into the vectors below, or into the mmap-ed file
+	const uint64_t *bits;
+	const uint64_t *counts;     // 2 words per 512-bit block
+	const uint64_t *samples;    // block holding the (512 * j)-th 1
+
+	std::vector<uint64_t> ownBits, ownCounts, ownSamples;
+	void *mapped;
+	size_t mappedSize;
+};
+
+#endif
@@ -0,0 +1,177 @@
+#include "column.h"
+
+#include <cerrno>
+#include <cstdlib>
+#include <utility>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// O_DIRECT wants buffer, offset and length aligned to the device block
+static const size_t kDirectAlign = 4096;
+
+Column::Column() : base(0), count(0), elemWidth(0), length(0), fd(-1) {}
+
+Column::~Column() {
+	release();
+}
+
+Column::Column(Column &&other) : base(0), count(0), elemWidth(0), length(0), fd(-1) {
+	*this = std::move(other);
+}
+
+Column &Column::operator=(Column &&other) {
+	if (this == &other) return *this;
+	release();
+	base = other.base;
+	count = other.count;
+	elemWidth = other.elemWidth;
+	length = other.length;
+	fd = other.fd;
+	other.base = 0;
+	other.count = other.length = 0;
+	other.fd = -1;
+	return *this;
+}
+
+void Column::release() {
+	if (base) munmap(base, length);
+	if (fd >= 0) close(fd);
+	base = 0;
+	length = 0;
+	fd = -1;
+}
+
+bool Column::map(const char *path, size_t width, Access access, Column &out) {
+
+	if (width != 4 && width != 8) return false;
+
+	int fd = open(path, access == SHARED ? O_RDWR : O_RDONLY);
+	if (fd < 0) return false;
+
+	struct stat st;
+	if (fstat(fd, &st) != 0 || size_t(st.st_size) % width != 0) {
+		close(fd);
+		return false;
+	}
+
+	Column col;
+	col.elemWidth = width;
+	col.count = st.st_size / width;
+	col.length = st.st_size;
+
+	// mmap() refuses a zero length, an empty column needs no mapping
+	if (col.length) {
+		int prot = access == READ ? PROT_READ : PROT_READ | PROT_WRITE;
+		int flags = access == SHARED ? MAP_SHARED : MAP_PRIVATE;
+		void *p = mmap(0, col.length, prot, flags, fd, 0);
+		if (p == MAP_FAILED) {
+			close(fd);
+			return false;
+		}
+		col.base = p;
+	}
+	if (access == SHARED) col.fd = fd;
+	else close(fd);
+
+	out = std::move(col);
+	return true;
+}
+
+/*
+The mapping keeps its length, so munmap() still covers it; only the
+pages past the new end are gone, and count keeps as<T>() short of them.
+*/
+bool Column::truncate(size_t n) {
+	if (fd < 0 || n > count) return false;
+	if (ftruncate(fd, off_t(n * elemWidth)) != 0) return false;
+	count = n;
+	return true;
+}
+
+void Column::advise(int advice) const {
+	if (base) madvise(base, length, advice);
+}
+
+ColumnReader::ColumnReader()
+	: fd(-1), buffer(0), capacity(0), elemWidth(0), remaining(0), isDirect(false), error(false) {}
+
+ColumnReader::~ColumnReader() {
+	close();
+}
+
+void ColumnReader::close() {
+	if (fd >= 0) ::close(fd);
+	free(buffer);
+	fd = -1;
+	buffer = 0;
+}
+
+bool ColumnReader::open(const char *path, size_t width, bool direct, size_t blockBytes) {
+
+	close();
+	error = false;
+	if (width != 4 && width != 8) return false;
+
+	isDirect = false;
+#ifdef O_DIRECT
+	if (direct) {
+		fd = ::open(path, O_RDONLY | O_DIRECT);
+		isDirect = fd >= 0;
+	}
+#else
+	(void)direct;
+#endif
+	// tmpfs and some others say EINVAL to O_DIRECT, read through the cache
+	if (fd < 0) fd = ::open(path, O_RDONLY);
+	if (fd < 0) return false;
+
+	struct stat st;
+	if (fstat(fd, &st) != 0 || size_t(st.st_size) % width != 0) {
+		close();
+		return false;
+	}
+	if (!isDirect) posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+	elemWidth = width;
+	remaining = st.st_size;
+	capacity = (blockBytes + kDirectAlign - 1) / kDirectAlign * kDirectAlign;
+	if (!capacity) capacity = kDirectAlign;
+
+	void *p = 0;
+	if (posix_memalign(&p, kDirectAlign, capacity) != 0) {
+		close();
+		return false;
+	}
+	buffer = static_cast<char *>(p);
+	return true;
+}
+
+size_t ColumnReader::next(const void *&block) {
+
+	if (fd < 0 || error || !remaining) return 0;
+
+	// Fill the whole block, read(2) may stop short
+	size_t want = capacity, got = 0;
+	while (got < want && got < remaining) {
+		ssize_t n = read(fd, buffer + got, want - got);
+		if (n < 0 && errno == EINTR) continue;
+		if (n < 0) {
+			error = true;
+			return 0;
+		}
+		if (n == 0) break;
+		got += n;
+	}
+
+	// capacity is a multiple of 8, only the end of a file can split a value
+	if (got > remaining) got = remaining;
+	if (got % elemWidth) {
+		error = true;
+		return 0;
+	}
+	remaining -= got;
+	block = buffer;
+	return got / elemWidth;
+}
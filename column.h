@@ -0,0 +1,98 @@
+#ifndef EPI_COLUMN_H
+#define EPI_COLUMN_H
+
+/*
+Binary column files: a flat array of native int32 or int64 values,
+no header. The driver in EPI.cpp runs the Chapter 6 routines straight
+over them instead of reading them into a std::vector first.
+
+	Column col;
+	if (!Column::map("prices.i32", 4, Column::PRIVATE, col)) ...
+	col.advise(MADV_SEQUENTIAL);
+	max_stock_diff_column(col.as<int32_t>(), col.size());
+
+READ maps the file read-only. PRIVATE is copy on write: a routine
+that works in place pays only for the pages it changes, and the file
+stays as it was. SHARED writes the changes back to the file, and
+truncate() cuts it to a routine's result, as del_dup_sorted leaves it.
+
+ColumnReader streams a file in large blocks with read(2), opened with
+O_DIRECT when asked. That is for one-pass routines over files bigger
+than RAM, where a mapping would only push everything else out of the
+page cache.
+
+	ColumnReader in;
+	in.open("prices.i64", 8, true);
+	const void *block;
+	while (size_t n = in.next(block)) ...     // n values at block
+*/
+
+#include <cstddef>
+#include <cstdint>
+
+class Column {
+
+public:
+	enum Access { READ, PRIVATE, SHARED };
+
+	Column();
+	~Column();
+
+	Column(Column &&other);
+	Column &operator=(Column &&other);
+
+	// width is 4 or 8; false if the file is missing or not whole values
+	static bool map(const char *path, size_t width, Access access, Column &out);
+
+	// madvise() over the whole mapping, MADV_SEQUENTIAL, MADV_RANDOM, ...
+	void advise(int advice) const;
+
+	// SHARED only: cut the file to its first n values, n <= size()
+	bool truncate(size_t n);
+
+	size_t size() const { return count; }
+	size_t width() const { return elemWidth; }
+	size_t bytes() const { return count * elemWidth; }
+
+	template<class T>
+	T *as() const { return static_cast<T *>(base); }
+
+private:
+	Column(const Column &);
+	Column &operator=(const Column &);
+
+	void release();
+
+	void *base;
+	size_t count, elemWidth, length;
+	int fd;                     // kept open for truncate(), SHARED only
+};
+
+class ColumnReader {
+
+public:
+	ColumnReader();
+	~ColumnReader();
+
+	// direct falls back to buffered reads where O_DIRECT is not supported
+	bool open(const char *path, size_t width, bool direct, size_t blockBytes = 4 << 20);
+
+	// Next block of whole values, 0 at the end of the file or on error
+	size_t next(const void *&block);
+
+	bool failed() const { return error; }
+	bool direct() const { return isDirect; }
+
+private:
+	ColumnReader(const ColumnReader &);
+	ColumnReader &operator=(const ColumnReader &);
+
+	void close();
+
+	int fd;
+	char *buffer;
+	size_t capacity, elemWidth, remaining;
+	bool isDirect, error;
+};
+
+#endif
@@ -0,0 +1,63 @@
+#include "combinations.h"
+
+static const unsigned kMaxN = 64;
+
+// Pascal's triangle, C(64, 32) is still below 2^64
+struct BinomialTable {
+	uint64_t c[kMaxN + 1][kMaxN + 1];
+	BinomialTable() {
+		for (unsigned n = 0; n <= kMaxN; ++n) {
+			c[n][0] = 1;
+			for (unsigned k = 1; k <= kMaxN; ++k)
+				c[n][k] = n ? c[n - 1][k - 1] + c[n - 1][k] : 0;
+		}
+	}
+};
+
+static const BinomialTable &binomials() {
+	static BinomialTable table;
+	return table;
+}
+
+uint64_t binomial(unsigned n, unsigned k) {
+	if (n > kMaxN || k > n) return 0;
+	return binomials().c[n][k];
+}
+
+/*
+The i-th smallest element e (from 1) has C(e, i) combinations before
+it that agree above e, so the rank is the sum of those.
+*/
+
+uint64_t combination_rank(uint64_t mask) {
+	const BinomialTable &t = binomials();
+	uint64_t rank = 0;
+	for (unsigned i = 1; mask; ++i) {
+		unsigned e = __builtin_ctzll(mask);
+		rank += t.c[e][i];
+		mask &= mask - 1;
+	}
+	return rank;
+}
+
+// Greedy from the top: the largest e with C(e, i) <= rank is the i-th element
+uint64_t combination_unrank(uint64_t rank, unsigned n, unsigned k) {
+	const BinomialTable &t = binomials();
+	uint64_t mask = 0;
+	unsigned e = n;
+	for (unsigned i = k; i > 0; --i) {
+		do --e; while (t.c[e][i] > rank);
+		rank -= t.c[e][i];
+		mask |= uint64_t(1) << e;
+	}
+	return mask;
+}
+
+RevolvingDoor::RevolvingDoor(unsigned n, unsigned k) : k(k), bits(0) {
+	for (unsigned j = 1; j <= k; ++j) {
+		c[j] = j - 1;
+		bits |= uint64_t(1) << (j - 1);
+	}
+	c[k + 1] = n;
+	c[0] = 0;
+}
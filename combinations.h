@@ -0,0 +1,170 @@
+#ifndef EPI_COMBINATIONS_H
+#define EPI_COMBINATIONS_H
+
+/*
+k-combinations and subsets of {0, ..., n - 1}, n <= 64, as bits of a
+word instead of a std::vector of indices, the way next_permt (6.10)
+steps through permutations.
+
+	for_each_combination(n, k, [&](uint64_t mask) { ... });
+
+	RevolvingDoor door(n, k);
+	unsigned out, in;
+	do { ... door.mask() ... } while (door.next(out, in));
+
+	uint64_t r = combination_rank(mask);            // position in colex order
+	uint64_t m = combination_unrank(r, n, k);
+
+	for_each_combination_parallel(pool, n, k, 1 << 16, [&](uint64_t mask) { ... });
+
+next_combination is Gosper's hack on the 5.1 lowest set bit trick:
+x & ~(x - 1) is the lowest set bit; adding it carries through the
+lowest run of 1s, and the bits that run lost are put back at the
+bottom. The words come in increasing order, which for combinations is
+colex order.
+
+RevolvingDoor is Knuth's Algorithm R (TAOCP 7.2.1.3): a Gray code for
+combinations where every step takes one element out and puts one in,
+so a caller can update a score in O(1) instead of recomputing it.
+for_each_subset_gray does the same for all 2^n subsets, one bit flips
+per step.
+
+Ranks count in colex order with a table of binomials up to C(64, 32),
+so a range of ranks splits the combination space evenly between
+threads: every chunk unranks its first word and walks from there.
+*/
+
+#include <cstddef>
+#include <cstdint>
+
+#include "pool.h"
+
+// C(n, k) for n <= 64, 0 if k > n
+uint64_t binomial(unsigned n, unsigned k);
+
+// Number of combinations of popcount(mask) elements before mask
+uint64_t combination_rank(uint64_t mask);
+
+// The combination of k elements of n with that rank, rank < C(n, k)
+uint64_t combination_unrank(uint64_t rank, unsigned n, unsigned k);
+
+// Gosper's hack: next larger word with the same number of 1s, x != 0
+inline uint64_t next_combination(uint64_t x) {
+	uint64_t low = x & ~(x - 1);
+	uint64_t ripple = x + low;
+	return ripple | (((x ^ ripple) >> 2) / low);
+}
+
+// f(mask) for the ranks [first, last) in colex order
+template<class F>
+void for_each_combination(unsigned n, unsigned k, uint64_t first, uint64_t last, F f) {
+	if (first >= last) return;
+	uint64_t x = combination_unrank(first, n, k);
+	for (uint64_t r = first + 1; r < last; ++r) {
+		f(x);
+		x = next_combination(x);
+	}
+	f(x);
+}
+
+template<class F>
+void for_each_combination(unsigned n, unsigned k, F f) {
+	for_each_combination(n, k, 0, binomial(n, k), f);
+}
+
+// Chunks of grain ranks on the pool, f is called from many threads
+template<class F>
+void for_each_combination_parallel(Pool &pool, unsigned n, unsigned k, size_t grain, F f) {
+	pool.parallel_for(0, binomial(n, k), grain, [&](size_t b, size_t e) {
+		for_each_combination(n, k, b, e, f);
+	});
+}
+
+// Every subset of mask, mask itself first and 0 last
+template<class F>
+void for_each_subset(uint64_t mask, F f) {
+	uint64_t s = mask;
+	do {
+		f(s);
+		s = (s - 1) & mask;
+	} while (s != mask);
+}
+
+// f(subset, bit) over all subsets of n < 64 elements in Gray code
+// order from 0, bit is the one that flipped (n for the first call)
+template<class F>
+void for_each_subset_gray(unsigned n, F f) {
+	uint64_t s = 0;
+	f(s, n);
+	for (uint64_t i = 1; i >> n == 0; ++i) {
+		unsigned bit = __builtin_ctzll(i);
+		s ^= uint64_t(1) << bit;
+		f(s, bit);
+	}
+}
+
+class RevolvingDoor {
+
+public:
+	// Starts at {0, ..., k - 1}, k <= n <= 64
+	RevolvingDoor(unsigned n, unsigned k);
+
+	uint64_t mask() const { return bits; }
+
+	// Elements in increasing order, k of them
+	const unsigned *elements() const { return c + 1; }
+
+	// Step to the next combination, false after the last one
+	bool next(unsigned &out, unsigned &in) {
+		if (k == 0) return false;
+		unsigned j;
+		if (k & 1) {
+			if (c[1] + 1 < c[2]) return move(1, c[1], c[1] + 1, out, in);
+			j = 2;
+		} else {
+			if (c[1] > 0) return move(1, c[1], c[1] - 1, out, in);
+			j = 2;
+			goto increase;
+		}
+		for (;;) {
+			// Try to decrease c[j], here c[j] == c[j - 1] + 1
+			if (j > k) return false;
+			if (c[j] >= j) {
+				unsigned gone = c[j];
+				c[j] = c[j - 1];
+				c[j - 1] = j - 2;
+				return swap(gone, j - 2, out, in);
+			}
+			++j;
+		increase:
+			// Try to increase c[j], here c[j - 1] == j - 2
+			if (j > k) return false;
+			if (c[j] + 1 < c[j + 1]) {
+				unsigned gone = c[j - 1];
+				c[j - 1] = c[j];
+				c[j] = c[j] + 1;
+				return swap(gone, c[j], out, in);
+			}
+			++j;
+		}
+	}
+
+private:
+	bool move(unsigned j, unsigned from, unsigned to, unsigned &out, unsigned &in) {
+		c[j] = to;
+		return swap(from, to, out, in);
+	}
+
+	bool swap(unsigned gone, unsigned added, unsigned &out, unsigned &in) {
+		bits ^= (uint64_t(1) << gone) | (uint64_t(1) << added);
+		out = gone;
+		in = added;
+		return true;
+	}
+
+	unsigned k;
+	unsigned c[66];             // c[1..k] the elements, c[k + 1] = n
+	uint64_t bits;
+};
+
+#endif
@@ -0,0 +1,124 @@
+#include "dispatch.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+#include <type_traits>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+// GCC only vectorizes very cheap loops at -O2, the kernels want -O3
+#pragma GCC optimize("O3")
+
+namespace dispatch {
+
+#define EPI_KERNEL_TABLE(tierId) { \
+	tierId, parityBatch, popcountWords, selectInWord, reverseBitsBatch, palindromeBatch, \
+	reverseDigits32, reverseDigits64 \
+}
+
+namespace scalar {
+#include "kernels.inc"
+static const Kernels table = EPI_KERNEL_TABLE(SCALAR);
+}
+
+#if defined(__x86_64__)
+
+// The pragma does not define __POPCNT__ etc. in C++, kernels.inc reads
+// these instead. Every tier keeps the ones of the tiers below it.
+
+#pragma GCC push_options
+#pragma GCC target("sse4.2,popcnt")
+#define EPI_POPCNT
+#define EPI_SSE41
+namespace sse42 {
+#include "kernels.inc"
+static const Kernels table = EPI_KERNEL_TABLE(SSE42);
+}
+#pragma GCC pop_options
+
+#pragma GCC push_options
+#pragma GCC target("avx2,bmi,bmi2,popcnt")
+#define EPI_AVX2
+#define EPI_BMI2
+namespace avx2 {
+#include "kernels.inc"
+static const Kernels table = EPI_KERNEL_TABLE(AVX2);
+}
+#pragma GCC pop_options
+
+#undef EPI_POPCNT
+#undef EPI_SSE41
+#undef EPI_AVX2
+#undef EPI_BMI2
+
+static const Kernels *tables[NUM_TIERS] = {
+	&scalar::table, &sse42::table, &avx2::table
+};
+
+static bool supported(Tier tier) {
+
+	__builtin_cpu_init();
+
+	switch (tier) {
+	case AVX2:
+		if (!__builtin_cpu_supports("avx2") || !__builtin_cpu_supports("bmi2")) return false;
+	// fall through
+	case SSE42:
+		if (!__builtin_cpu_supports("sse4.2") || !__builtin_cpu_supports("popcnt")) return false;
+	// fall through
+	default:
+		return true;
+	}
+}
+
+#else
+
+// Other architectures only get the portable build
+static const Kernels *tables[NUM_TIERS] = {
+	&scalar::table, &scalar::table, &scalar::table
+};
+
+static bool supported(Tier tier) {
+	return tier == SCALAR;
+}
+
+#endif
+
+#undef EPI_KERNEL_TABLE
+
+// Valid from static initialization on, upgraded by bindAtStartup()
+Kernels active = scalar::table;
+
+const char *tierName(Tier tier) {
+	static const char *names[NUM_TIERS] = {"scalar", "sse42", "avx2"};
+	return tier >= 0 && tier < NUM_TIERS ? names[tier] : "unknown";
+}
+
+Tier detect() {
+	int tier = NUM_TIERS - 1;
+	while (tier > SCALAR && !supported(static_cast<Tier>(tier))) --tier;
+	return static_cast<Tier>(tier);
+}
+
+bool force(Tier tier) {
+	if (tier < SCALAR || tier >= NUM_TIERS || !supported(tier)) return false;
+	active = *tables[tier];
+	return true;
+}
+
+__attribute__((constructor))
+static void bindAtStartup() {
+
+	const char *env = getenv("EPI_ISA");
+	if (env) {
+		for (int tier = SCALAR; tier < NUM_TIERS; ++tier) {
+			if (!strcmp(env, tierName(static_cast<Tier>(tier))) && force(static_cast<Tier>(tier))) return;
+		}
+	}
+	force(detect());
+}
+
+} // namespace dispatch
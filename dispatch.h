@@ -0,0 +1,56 @@
+#ifndef EPI_DISPATCH_H
+#define EPI_DISPATCH_H
+
+/*
+Runtime CPU-feature dispatch for the word and array kernels.
+
+Each kernel in kernels.inc is compiled once per tier. At startup the
+best tier this CPU supports is bound into dispatch::active, so calls
+go straight through a function pointer with no per-call check:
+
+	dispatch::active.parityBatch(words, n, out);
+
+A tier is only worth its copy when some kernel uses what it adds, so
+there is none for AVX-512 yet. Set EPI_ISA=scalar|sse42|avx2 to pick
+a tier at startup, or call dispatch::force() (e.g. in tests). A tier
+the CPU lacks is refused rather than crashing later on an illegal
+instruction.
+*/
+
+#include <cstddef>
+#include <cstdint>
+
+namespace dispatch {
+
+enum Tier {
+	SCALAR,     // baseline x86-64
+	SSE42,      // + SSE4.2, POPCNT
+	AVX2,       // + AVX2, BMI2
+	NUM_TIERS
+};
+
+struct Kernels {
+	Tier tier;
+	void (*parityBatch)(const uint64_t *in, size_t n, unsigned char *out);
+	void (*popcountWords)(const uint64_t *in, size_t n, unsigned char *out);
+	unsigned (*selectInWord)(uint64_t w, unsigned r);
+	void (*reverseBitsBatch)(const uint64_t *in, size_t n, uint64_t *out);
+	void (*palindromeBatch)(const uint64_t *in, size_t n, unsigned char *out);
+	size_t (*reverseDigits32)(const int32_t *in, int32_t *out, unsigned char *ok, size_t n);
+	size_t (*reverseDigits64)(const int64_t *in, int64_t *out, unsigned char *ok, size_t n);
+};
+
+// Bound once before main(), see force()
+extern Kernels active;
+
+const char *tierName(Tier tier);
+
+// Best tier supported by this CPU
+Tier detect();
+
+// Rebind active to tier, false (and no change) if the CPU lacks it
+bool force(Tier tier);
+
+} // namespace dispatch
+
+#endif
@@ -0,0 +1,397 @@
+#ifndef EPI_PIPELINE_H
+#define EPI_PIPELINE_H
+
+/*
+Morsel-driven pipeline for chains of array routines, so a chain of
+stages costs about one sweep over memory instead of one per stage.
+
+	unsigned best = 0;
+	Pipeline<int> p;
+	p.map("clamp", [](int x) { return std::max(x, 0); })
+	 .filter("nonzero", [](int x) { return x != 0; })
+	 .then(del_dup_sorted_stage<int>())
+	 .then(max_stock_diff_stage<int>(best));
+	p.run(v.data(), v.size());
+	p.report(stderr);
+
+The input goes through in morsels of about 256KB, each copied once
+into a buffer that then stays in cache from stage to stage.
+
+map() and filter() are element-wise. Adjacent ones are fused into one
+pass, which walks the morsel in strips of 1024 values and runs every
+op over a strip while it is in L1, so each op is still its own tight
+loop that the compiler can vectorize.
+
+then() adds a Stage that keeps state across morsels and sees them in
+order, like 6.5 over a sorted stream. Each such stage runs with the
+element-wise ops after it on a thread of its own, fed by the thread
+before it through a bounded queue. The buffers travel along the
+queues and come back on a free list, so nothing is allocated per
+morsel. run(data, n, false) runs everything on the caller instead.
+
+stats() counts per pass (a Stage, or a group of fused ops): values in
+and out, morsels, and nanoseconds busy, not counting the time spent
+downstream or waiting on a queue. Stages keep their state, so build a
+new Pipeline for every input.
+*/
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+template<class T> class Pipeline;
+template<class T> class Emitter;
+
+template<class T>
+class Stage {
+
+public:
+	explicit Stage(const std::string &name) : name(name) {}
+	virtual ~Stage() {}
+
+	// v[0, n) is the stage's to change, returns how many of v[0, ...) go on
+	virtual size_t push(T *v, size_t n, Emitter<T> &out) = 0;
+
+	// End of the input, a stage that held values back emits them now
+	virtual void finish(Emitter<T> &out) { (void)out; }
+
+	std::string name;
+};
+
+struct StageStats {
+	std::string name;
+	unsigned thread;
+	uint64_t in, out, morsels, nanos;
+};
+
+// Bounded blocking FIFO, a fixed ring, no allocation after construction
+template<class X>
+class BoundedQueue {
+
+public:
+	explicit BoundedQueue(size_t capacity) : ring(capacity ? capacity : 1), head(0), count(0), closed(false) {}
+
+	void push(const X &x) {
+		std::unique_lock<std::mutex> guard(lock);
+		notFull.wait(guard, [this] { return count < ring.size(); });
+		ring[(head + count++) % ring.size()] = x;
+		notEmpty.notify_one();
+	}
+
+	// false once the queue is closed and drained
+	bool pop(X &x) {
+		std::unique_lock<std::mutex> guard(lock);
+		notEmpty.wait(guard, [this] { return count > 0 || closed; });
+		if (!count) return false;
+		x = ring[head];
+		head = (head + 1) % ring.size();
+		--count;
+		notFull.notify_one();
+		return true;
+	}
+
+	void close() {
+		std::lock_guard<std::mutex> guard(lock);
+		closed = true;
+		notEmpty.notify_all();
+	}
+
+private:
+	std::vector<X> ring;
+	size_t head, count;
+	bool closed;
+	std::mutex lock;
+	std::condition_variable notEmpty, notFull;
+};
+
+template<class T>
+class Emitter {
+
+public:
+	// Copy v[0, n) into morsels for the stages after this one
+	void emit(const T *v, size_t n) {
+		pipeline->emitFrom(*this, v, n);
+	}
+
+private:
+	friend class Pipeline<T>;
+
+	Emitter(Pipeline<T> *pipeline, size_t segment, size_t next)
+		: pipeline(pipeline), segment(segment), next(next), emitted(0), downstream(0) {}
+
+	Pipeline<T> *pipeline;
+	size_t segment, next;
+	uint64_t emitted, downstream;
+};
+
+template<class T>
+class Pipeline {
+
+public:
+	explicit Pipeline(size_t morselBytes = 256 << 10, size_t queueDepth = 4)
+		: maxMorsel(std::max<size_t>(morselBytes / sizeof(T), kStrip)), morsel(0),
+		  depth(queueDepth ? queueDepth : 1), freeBuffers(0) {}
+
+	~Pipeline() {
+		for (size_t i = 0; i < stages.size(); ++i) delete stages[i].stage;
+	}
+
+	// Element-wise T -> T
+	template<class F>
+	Pipeline &map(const std::string &name, F f) {
+		fused(name).add(&Fused::template applyMap<F>, new F(f), &Fused::template destroy<F>);
+		return *this;
+	}
+
+	// Keeps the values for which f(x) is true
+	template<class F>
+	Pipeline &filter(const std::string &name, F f) {
+		fused(name).add(&Fused::template applyFilter<F>, new F(f), &Fused::template destroy<F>);
+		return *this;
+	}
+
+	// Takes ownership of stage
+	Pipeline &then(Stage<T> *stage) {
+		stages.push_back(Entry(stage, false));
+		return *this;
+	}
+
+	// Push data[0, n) through every stage
+	void run(const T *data, size_t n, bool threaded = true) {
+
+		// A new thread at every then() stage except a leading one
+		segments.clear();
+		segments.push_back(0);
+		for (size_t i = 1; i < stages.size(); ++i) {
+			if (threaded && !stages[i].fused) segments.push_back(i);
+		}
+		segments.push_back(stages.size());
+		size_t numSegments = segments.size() - 1;
+
+		for (size_t i = 0; i < stages.size(); ++i) {
+			StageStats s = {stages[i].stage->name, 0, 0, 0, 0, 0};
+			stages[i].stats = s;
+		}
+		for (size_t s = 0; s < numSegments; ++s) {
+			for (size_t i = segments[s]; i < segments[s + 1]; ++i) stages[i].stats.thread = s;
+		}
+
+		// A thread holds one buffer, plus one for each emit() nested in
+		// its stages, and the queues hold the rest. Small inputs get small
+		// buffers, and they are not zeroed.
+		morsel = std::min(maxMorsel, (n + kStrip - 1) / kStrip * kStrip + kStrip);
+		size_t buffers = numSegments * (depth + 2) + stages.size() + 1;
+		std::unique_ptr<T[]> storage(new T[buffers * morsel]);
+		BoundedQueue<T *> freeList(buffers);
+		for (size_t i = 0; i < buffers; ++i) freeList.push(&storage[i * morsel]);
+		freeBuffers = &freeList;
+
+		for (size_t s = 0; s + 1 < numSegments; ++s) queues.push_back(new BoundedQueue<Chunk>(depth));
+
+		std::vector<std::thread> threads;
+		for (size_t s = 1; s < numSegments; ++s) threads.push_back(std::thread(&Pipeline::consume, this, s));
+
+		for (size_t begin = 0; begin < n; begin += morsel) {
+			size_t len = std::min(morsel, n - begin);
+			T *buf = acquire();
+			std::copy(data + begin, data + begin + len, buf);
+			flow(0, 0, buf, len);
+		}
+		finishSegment(0);
+
+		for (size_t i = 0; i < threads.size(); ++i) threads[i].join();
+		for (size_t i = 0; i < queues.size(); ++i) delete queues[i];
+		queues.clear();
+		freeBuffers = 0;
+	}
+
+	std::vector<StageStats> stats() const {
+		std::vector<StageStats> res;
+		for (size_t i = 0; i < stages.size(); ++i) res.push_back(stages[i].stats);
+		return res;
+	}
+
+	void report(FILE *out) const {
+		fprintf(out, "%-32s %6s %12s %12s %8s %10s\n", "stage", "thread", "in", "out", "morsels", "ms");
+		for (size_t i = 0; i < stages.size(); ++i) {
+			const StageStats &s = stages[i].stats;
+			fprintf(out, "%-32s %6u %12llu %12llu %8llu %10.3f\n", s.name.c_str(), s.thread,
+			        (unsigned long long)s.in, (unsigned long long)s.out,
+			        (unsigned long long)s.morsels, s.nanos / 1e6);
+		}
+	}
+
+private:
+	friend class Emitter<T>;
+
+	static const size_t kStrip = 1024;
+
+	struct Chunk {
+		T *data;
+		size_t n;
+	};
+
+	// A run of map()/filter() ops, applied strip by strip
+	class Fused : public Stage<T> {
+
+	public:
+		explicit Fused(const std::string &name) : Stage<T>(name) {}
+
+		~Fused() {
+			for (size_t i = 0; i < ops.size(); ++i) ops[i].destroy(ops[i].fn);
+		}
+
+		void add(size_t (*apply)(void *, T *, size_t), void *fn, void (*destroy)(void *)) {
+			Op op = {apply, fn, destroy};
+			ops.push_back(op);
+		}
+
+		size_t push(T *v, size_t n, Emitter<T> &) {
+			size_t kept = 0;
+			for (size_t s = 0; s < n; s += kStrip) {
+				T *strip = v + s;
+				size_t len = std::min(kStrip, n - s);
+				for (size_t i = 0; i < ops.size() && len; ++i) len = ops[i].apply(ops[i].fn, strip, len);
+				// kept <= s, so copying forward is safe
+				if (kept != s) std::copy(strip, strip + len, v + kept);
+				kept += len;
+			}
+			return kept;
+		}
+
+		template<class F>
+		static size_t applyMap(void *fn, T *v, size_t n) {
+			F &f = *static_cast<F *>(fn);
+			for (size_t i = 0; i < n; ++i) v[i] = f(v[i]);
+			return n;
+		}
+
+		// Branch-free: always store, advance only past the kept ones
+		template<class F>
+		static size_t applyFilter(void *fn, T *v, size_t n) {
+			F &f = *static_cast<F *>(fn);
+			size_t k = 0;
+			for (size_t i = 0; i < n; ++i) {
+				T x = v[i];
+				v[k] = x;
+				k += f(x) ? 1 : 0;
+			}
+			return k;
+		}
+
+		template<class F>
+		static void destroy(void *fn) { delete static_cast<F *>(fn); }
+
+	private:
+		struct Op {
+			size_t (*apply)(void *, T *, size_t);
+			void *fn;
+			void (*destroy)(void *);
+		};
+		std::vector<Op> ops;
+	};
+
+	struct Entry {
+		Stage<T> *stage;
+		bool fused;
+		StageStats stats;
+		Entry(Stage<T> *stage, bool fused) : stage(stage), fused(fused), stats() {}
+	};
+
+	size_t maxMorsel, morsel, depth;
+	std::vector<Entry> stages;
+	std::vector<size_t> segments;           // first stage of each thread, then stages.size()
+	std::vector<BoundedQueue<Chunk> *> queues;   // [s] feeds segment s + 1
+	BoundedQueue<T *> *freeBuffers;
+
+	static uint64_t now() {
+		return std::chrono::duration_cast<std::chrono::nanoseconds>(
+		           std::chrono::steady_clock::now().time_since_epoch()).count();
+	}
+
+	Fused &fused(const std::string &name) {
+		if (stages.empty() || !stages.back().fused) {
+			stages.push_back(Entry(new Fused(name), true));
+		} else {
+			stages.back().stage->name += "+" + name;
+		}
+		return *static_cast<Fused *>(stages.back().stage);
+	}
+
+	T *acquire() {
+		T *buf = 0;
+		freeBuffers->pop(buf);
+		return buf;
+	}
+
+	// buf[0, n) through stages [first, end of segment), then to the next thread
+	void flow(size_t segment, size_t first, T *buf, size_t n) {
+
+		for (size_t i = first; i < segments[segment + 1]; ++i) {
+			Entry &e = stages[i];
+			Emitter<T> out(this, segment, i + 1);
+
+			uint64_t start = now();
+			size_t kept = e.stage->push(buf, n, out);
+			e.stats.nanos += now() - start - out.downstream;
+			e.stats.in += n;
+			e.stats.out += kept + out.emitted;
+			e.stats.morsels++;
+
+			n = kept;
+			if (!n) {
+				freeBuffers->push(buf);
+				return;
+			}
+		}
+
+		if (segment + 1 < segments.size() - 1) {
+			Chunk c = {buf, n};
+			queues[segment]->push(c);
+		} else {
+			freeBuffers->push(buf);
+		}
+	}
+
+	void emitFrom(Emitter<T> &out, const T *v, size_t n) {
+		uint64_t start = now();
+		for (size_t begin = 0; begin < n; begin += morsel) {
+			size_t len = std::min(morsel, n - begin);
+			T *buf = acquire();
+			std::copy(v + begin, v + begin + len, buf);
+			flow(out.segment, out.next, buf, len);
+		}
+		out.emitted += n;
+		out.downstream += now() - start;
+	}
+
+	void finishSegment(size_t segment) {
+		for (size_t i = segments[segment]; i < segments[segment + 1]; ++i) {
+			Emitter<T> out(this, segment, i + 1);
+			uint64_t start = now();
+			stages[i].stage->finish(out);
+			stages[i].stats.nanos += now() - start - out.downstream;
+			stages[i].stats.out += out.emitted;
+		}
+		if (segment < queues.size()) queues[segment]->close();
+	}
+
+	void consume(size_t segment) {
+		Chunk c;
+		while (queues[segment - 1]->pop(c)) flow(segment, segments[segment], c.data, c.n);
+		finishSegment(segment);
+	}
+};
+
+template<class T>
+const size_t Pipeline<T>::kStrip;
+
+#endif
@@ -0,0 +1,267 @@
+#include "pool.h"
+
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+/*
+Chase-Lev deque with a fixed ring of slots (Le et al., "Correct and
+Efficient Work-Stealing for Weak Memory Models"). The owner pushes
+and pops at the bottom, thieves take from the top. When the ring is
+full, spawn() runs the task inline instead.
+*/
+class Pool::WorkDeque {
+
+public:
+	WorkDeque() : top(0), bottom(0) {
+		for (size_t i = 0; i < kCapacity; ++i) slots[i].store(0, std::memory_order_relaxed);
+	}
+
+	bool push(Task *task) {
+		int64_t b = bottom.load(std::memory_order_relaxed);
+		int64_t t = top.load(std::memory_order_acquire);
+		if (b - t >= int64_t(kCapacity)) return false;
+		slots[b & kMask].store(task, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_release);
+		bottom.store(b + 1, std::memory_order_relaxed);
+		return true;
+	}
+
+	Task *pop() {
+		int64_t b = bottom.load(std::memory_order_relaxed) - 1;
+		bottom.store(b, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		int64_t t = top.load(std::memory_order_relaxed);
+
+		if (t > b) {
+			bottom.store(b + 1, std::memory_order_relaxed);
+			return 0;
+		}
+		Task *task = slots[b & kMask].load(std::memory_order_relaxed);
+		if (t == b) {
+			// Last one, race the thieves for it
+			if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst,
+			                                 std::memory_order_relaxed)) task = 0;
+			bottom.store(b + 1, std::memory_order_relaxed);
+		}
+		return task;
+	}
+
+	Task *steal() {
+		int64_t t = top.load(std::memory_order_acquire);
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		int64_t b = bottom.load(std::memory_order_acquire);
+
+		if (t >= b) return 0;
+		Task *task = slots[t & kMask].load(std::memory_order_acquire);
+		if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst,
+		                                 std::memory_order_relaxed)) return 0;
+		return task;
+	}
+
+private:
+	static const size_t kCapacity = 1 << 12;
+	static const size_t kMask = kCapacity - 1;
+
+	// Owner and thieves hit different ends, keep them off one cache line
+	std::atomic<int64_t> top;
+	char padTop[64 - sizeof(std::atomic<int64_t>)];
+	std::atomic<int64_t> bottom;
+	char padBottom[64 - sizeof(std::atomic<int64_t>)];
+	std::atomic<Task *> slots[kCapacity];
+};
+
+// Which pool (if any) the current thread works for, and its deque
+static thread_local Pool *currentPool = 0;
+static thread_local unsigned currentIndex = 0;
+
+/*
+CPUs this process may run on, grouped by NUMA node. Falls back to
+0..n-1 when sysfs or the affinity mask is not readable.
+*/
+static std::vector<int> cpusByNode() {
+
+	std::vector<int> cpus;
+
+#ifdef __linux__
+	cpu_set_t allowed;
+	CPU_ZERO(&allowed);
+	bool haveMask = sched_getaffinity(0, sizeof allowed, &allowed) == 0;
+
+	for (int node = 0; node < 1024; ++node) {
+		std::string path = "/sys/devices/system/node/node" + std::to_string(node) + "/cpulist";
+		FILE *f = fopen(path.c_str(), "r");
+		if (!f) {
+			if (node == 0) break;
+			continue;
+		}
+		// Format: "0-3,8-11"
+		int lo, hi;
+		char sep;
+		while (fscanf(f, "%d", &lo) == 1) {
+			hi = lo;
+			if (fscanf(f, "%c", &sep) == 1 && sep == '-') {
+				if (fscanf(f, "%d", &hi) != 1) break;
+				if (fscanf(f, "%c", &sep) != 1) sep = '\n';
+			}
+			for (int cpu = lo; cpu <= hi; ++cpu) {
+				if (!haveMask || CPU_ISSET(cpu, &allowed)) cpus.push_back(cpu);
+			}
+			if (sep != ',') break;
+		}
+		fclose(f);
+	}
+
+	if (cpus.empty() && haveMask) {
+		for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+			if (CPU_ISSET(cpu, &allowed)) cpus.push_back(cpu);
+		}
+	}
+#endif
+
+	return cpus;
+}
+
+// More would be a typo, not a machine
+static const long kMaxThreads = 4096;
+
+// EPI_THREADS if it is a count in [1, kMaxThreads], else every core
+static unsigned threadsFromEnv() {
+
+	const char *env = getenv("EPI_THREADS");
+	if (env) {
+		char *end;
+		errno = 0;
+		long n = strtol(env, &end, 10);
+		if (end != env && !*end && !errno && n > 0 && n <= kMaxThreads) return unsigned(n);
+		fprintf(stderr, "EPI: ignoring EPI_THREADS=%s, not a thread count in 1..%ld\n", env, kMaxThreads);
+	}
+	return std::thread::hardware_concurrency();
+}
+
+Pool::Pool(unsigned threads, bool pin) : stopping(false), activeCalls(0) {
+
+	if (!threads) threads = threadsFromEnv();
+	numThreads = threads ? threads : 1;
+
+	for (unsigned i = 0; i < numThreads; ++i) deques.push_back(new WorkDeque());
+
+	std::vector<int> cpus = pin ? cpusByNode() : std::vector<int>();
+	if (cpus.size() < numThreads) cpus.clear();
+
+	// Slot 0 is whoever calls in, workers take 1..n-1
+	for (unsigned i = 1; i < numThreads; ++i) {
+		workers.push_back(std::thread(&Pool::workerLoop, this, i, cpus.empty() ? -1 : cpus[i]));
+	}
+}
+
+Pool::~Pool() {
+	{
+		std::lock_guard<std::mutex> guard(sleepLock);
+		stopping.store(true);
+	}
+	wake.notify_all();
+	for (size_t i = 0; i < workers.size(); ++i) workers[i].join();
+	for (size_t i = 0; i < deques.size(); ++i) delete deques[i];
+}
+
+Pool::Entry::Entry(Pool &pool)
+	: pool(pool), outside(currentPool != &pool), prevPool(currentPool), prevIndex(currentIndex) {
+	if (!outside) return;
+
+	pool.callerLock.lock();
+	currentPool = &pool;
+	currentIndex = 0;
+	{
+		std::lock_guard<std::mutex> guard(pool.sleepLock);
+		pool.activeCalls.fetch_add(1);
+	}
+	pool.wake.notify_all();
+}
+
+Pool::Entry::~Entry() {
+	if (!outside) return;
+
+	pool.activeCalls.fetch_sub(1);
+	currentPool = prevPool;
+	currentIndex = prevIndex;
+	pool.callerLock.unlock();
+}
+
+// Nothing may escape here, the caller may be a worker thread
+void Pool::execute(Task *task) {
+	try {
+		task->run(task);
+	} catch (...) {
+		task->error = std::current_exception();
+	}
+	task->done.store(true, std::memory_order_release);
+}
+
+void Pool::spawn(Task *task) {
+	if (!deques[currentIndex]->push(task)) execute(task);
+}
+
+Pool::Task *Pool::findWork(unsigned self) {
+
+	Task *task = deques[self]->pop();
+	if (task) return task;
+
+	// Neighbours first, they were pinned to the same node
+	for (unsigned i = 1; i < numThreads; ++i) {
+		task = deques[(self + i) % numThreads]->steal();
+		if (task) return task;
+	}
+	return 0;
+}
+
+void Pool::wait(Task *task) {
+	while (!task->done.load(std::memory_order_acquire)) {
+		Task *other = findWork(currentIndex);
+		if (other) execute(other);
+		else std::this_thread::yield();
+	}
+}
+
+void Pool::join(Task *task) {
+	wait(task);
+	if (task->error) std::rethrow_exception(task->error);
+}
+
+void Pool::workerLoop(unsigned index, int cpu) {
+
+#ifdef __linux__
+	if (cpu >= 0) {
+		cpu_set_t set;
+		CPU_ZERO(&set);
+		CPU_SET(cpu, &set);
+		pthread_setaffinity_np(pthread_self(), sizeof set, &set);
+	}
+#else
+	(void)cpu;
+#endif
+
+	currentPool = this;
+	currentIndex = index;
+
+	while (!stopping.load()) {
+
+		Task *task = findWork(index);
+		if (task) {
+			execute(task);
+			continue;
+		}
+		if (activeCalls.load() > 0) {
+			std::this_thread::yield();
+			continue;
+		}
+		std::unique_lock<std::mutex> guard(sleepLock);
+		wake.wait(guard, [this] { return stopping.load() || activeCalls.load() > 0; });
+	}
+}
@@ -0,0 +1,167 @@
+#ifndef EPI_POOL_H
+#define EPI_POOL_H
+
+/*
+Work-stealing thread pool for the parallel versions of the Chapter 6
+routines.
+
+	Pool pool;                                   // EPI_THREADS or all cores
+	pool.parallel_for(0, n, 4096, [&](size_t b, size_t e) { ... });
+	long sum = pool.parallel_reduce(0, n, 4096, 0L,
+	    [&](size_t b, size_t e) { ... return partial; },
+	    [](long a, long b) { return a + b; });
+
+Every worker owns a Chase-Lev deque. A parallel call splits its range
+in halves down to the grain size: the right half is pushed on the
+caller's deque, the left half runs right away, and an idle worker
+steals from the other end. While waiting for a stolen half, a thread
+runs other tasks instead of blocking. An exception thrown by a chunk
+is kept in its task and rethrown on the thread that joins it, once no
+other thread can still reach the task.
+
+The split tree depends only on (begin, end, grain), so parallel_reduce
+combines partial results in the same order for any thread count.
+Pool(1) starts no threads at all and runs every chunk on the caller in
+order, which is the deterministic mode for tests.
+
+Workers are pinned to the allowed CPUs node by node, so neighbours in
+the steal order (i + 1, i + 2, ...) mostly share a NUMA node.
+*/
+
+#include <atomic>
+#include <exception>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+class Pool {
+
+public:
+	// 0 threads means EPI_THREADS from the environment if it is a count
+	// in 1..4096, else all cores
+	explicit Pool(unsigned threads = 0, bool pin = true);
+	~Pool();
+
+	unsigned size() const { return numThreads; }
+
+	// f(b, e) over [begin, end) in chunks of at most grain elements
+	template<class F>
+	void parallel_for(size_t begin, size_t end, size_t grain, F f) {
+		Entry entry(*this);
+		forRange(begin, end, grain ? grain : 1, f);
+	}
+
+	// combine(map(b, e), ...) over the same split tree as parallel_for
+	template<class T, class Map, class Combine>
+	T parallel_reduce(size_t begin, size_t end, size_t grain, T identity, Map map, Combine combine) {
+		Entry entry(*this);
+		if (begin >= end) return identity;
+		return reduceRange<T>(begin, end, grain ? grain : 1, map, combine);
+	}
+
+	struct Task {
+		void (*run)(Task *task);
+		std::atomic<bool> done;
+		std::exception_ptr error;
+		Task(void (*run)(Task *)) : run(run), done(false) {}
+	};
+
+private:
+	class WorkDeque;
+
+	unsigned numThreads;
+	std::vector<WorkDeque *> deques;      // [0] is the external caller
+	std::vector<std::thread> workers;
+	std::atomic<bool> stopping;
+	std::atomic<int> activeCalls;
+	std::mutex sleepLock;
+	std::condition_variable wake;
+	std::mutex callerLock;
+
+	void workerLoop(unsigned index, int cpu);
+	void spawn(Task *task);
+	void wait(Task *task);
+	void join(Task *task);          // wait(), then rethrow what the task threw
+	Task *findWork(unsigned self);
+	static void execute(Task *task);
+
+	// Marks a top-level call. Outside threads take slot 0 one at a time.
+	struct Entry {
+		Pool &pool;
+		bool outside;
+		Pool *prevPool;        // a worker of another pool calling in
+		unsigned prevIndex;
+		explicit Entry(Pool &pool);
+		~Entry();
+	};
+
+	template<class F>
+	struct ForTask : Task {
+		Pool *pool;
+		size_t begin, end, grain;
+		F *f;
+		ForTask(Pool *pool, size_t begin, size_t end, size_t grain, F *f)
+			: Task(&ForTask::exec), pool(pool), begin(begin), end(end), grain(grain), f(f) {}
+		static void exec(Task *task) {
+			ForTask *t = static_cast<ForTask *>(task);
+			t->pool->forRange(t->begin, t->end, t->grain, *t->f);
+		}
+	};
+
+	template<class F>
+	void forRange(size_t begin, size_t end, size_t grain, F &f) {
+		if (end - begin <= grain || begin >= end) {
+			if (begin < end) f(begin, end);
+			return;
+		}
+		size_t mid = begin + (end - begin) / 2;
+		ForTask<F> right(this, mid, end, grain, &f);
+		spawn(&right);
+		try {
+			forRange(begin, mid, grain, f);
+		} catch (...) {
+			// right lives in this frame, it has to finish before we unwind
+			wait(&right);
+			throw;
+		}
+		join(&right);
+	}
+
+	template<class T, class Map, class Combine>
+	struct ReduceTask : Task {
+		Pool *pool;
+		size_t begin, end, grain;
+		Map *map;
+		Combine *combine;
+		T result;
+		ReduceTask(Pool *pool, size_t begin, size_t end, size_t grain, Map *map, Combine *combine)
+			: Task(&ReduceTask::exec), pool(pool), begin(begin), end(end), grain(grain),
+			  map(map), combine(combine), result() {}
+		static void exec(Task *task) {
+			ReduceTask *t = static_cast<ReduceTask *>(task);
+			t->result = t->pool->template reduceRange<T>(t->begin, t->end, t->grain, *t->map, *t->combine);
+		}
+	};
+
+	template<class T, class Map, class Combine>
+	T reduceRange(size_t begin, size_t end, size_t grain, Map &map, Combine &combine) {
+		if (end - begin <= grain) return map(begin, end);
+		size_t mid = begin + (end - begin) / 2;
+		ReduceTask<T, Map, Combine> right(this, mid, end, grain, &map, &combine);
+		spawn(&right);
+		T left;
+		try {
+			left = reduceRange<T>(begin, mid, grain, map, combine);
+		} catch (...) {
+			wait(&right);
+			throw;
+		}
+		join(&right);
+		return combine(left, right.result);
+	}
+};
+
+#endif
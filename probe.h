@@ -0,0 +1,288 @@
+#ifndef EPI_PROBE_H
+#define EPI_PROBE_H
+
+/*
+Scoped hardware-counter probes for the hot paths in EPI.cpp.
+
+	void rearrange(std::vector<int> &v, int idx) {
+		EPI_PROBE("rearrange");
+		...
+	}
+
+or, around a call you don't want to edit:
+
+	auto primes = EPI_PROBE_CALL("primer_array", primer_array(N));
+
+Build with -DEPI_PROBES to turn them on, otherwise EPI_PROBE is empty.
+Each probe reads cycles, instructions, cache misses and branch misses
+through perf_event_open at entry and exit. Where perf events are not
+available (no PMU access, perf_event_paranoid, non-Linux) only cycles
+are kept, from rdtsc.
+
+Every thread counts into its own block, the hot path takes no lock and
+does no atomic read-modify-write. A thread's block is linked into a
+global list once, the first time it hits a probe. The report (per site
+totals and a log2 histogram of cycles per call) goes to stderr at exit,
+or to the file named by EPI_PROBE_REPORT.
+*/
+
+#include <atomic>
+#include <mutex>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cstdint>
+#include <chrono>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <sys/ioctl.h>
+#endif
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+namespace probe {
+
+enum Counter { CYCLES, INSTRUCTIONS, CACHE_MISSES, BRANCH_MISSES, NUM_COUNTERS };
+
+static const int kMaxSites = 64;
+static const int kBuckets = 48;
+
+inline uint64_t timestamp() {
+#if defined(__x86_64__) || defined(__i386__)
+	return __rdtsc();
+#else
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(
+	           std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+// Counts of one site in one thread. Only the owner writes, so relaxed
+// load + store is enough, and the exit report can still read it safely.
+struct SiteStats {
+	std::atomic<uint64_t> calls;
+	std::atomic<uint64_t> total[NUM_COUNTERS];
+	std::atomic<uint64_t> histogram[kBuckets];
+};
+
+inline void bump(std::atomic<uint64_t> &x, uint64_t by) {
+	x.store(x.load(std::memory_order_relaxed) + by, std::memory_order_relaxed);
+}
+
+struct ThreadBlock {
+	SiteStats sites[kMaxSites];
+	ThreadBlock *next;
+};
+
+struct Registry {
+
+	std::mutex lock;
+	const char *names[kMaxSites];
+	std::atomic<int> numSites;
+	ThreadBlock *threads;
+	std::atomic<bool> hardware;
+
+	Registry() : numSites(0), threads(0), hardware(false) {}
+
+	// Printed once, from a static destructor at exit
+	~Registry() { report(); }
+
+	static Registry &get() {
+		static Registry registry;
+		return registry;
+	}
+
+	int addSite(const char *name) {
+		std::lock_guard<std::mutex> guard(lock);
+		int id = numSites.load();
+		if (id == kMaxSites) return -1;
+		names[id] = name;
+		numSites.store(id + 1);
+		return id;
+	}
+
+	void addThread(ThreadBlock *block) {
+		std::lock_guard<std::mutex> guard(lock);
+		block->next = threads;
+		threads = block;
+	}
+
+	void report() {
+
+		const char *path = getenv("EPI_PROBE_REPORT");
+		FILE *out = path ? fopen(path, "w") : stderr;
+		if (!out) return;
+
+		std::lock_guard<std::mutex> guard(lock);
+		fprintf(out, "== EPI probes (%s) ==\n", hardware.load() ? "perf_event" : "rdtsc cycles only");
+
+		for (int s = 0; s < numSites.load(); ++s) {
+
+			uint64_t calls = 0, total[NUM_COUNTERS] = {0}, hist[kBuckets] = {0};
+			for (ThreadBlock *t = threads; t; t = t->next) {
+				calls += t->sites[s].calls.load(std::memory_order_relaxed);
+				for (int c = 0; c < NUM_COUNTERS; ++c) {
+					total[c] += t->sites[s].total[c].load(std::memory_order_relaxed);
+				}
+				for (int b = 0; b < kBuckets; ++b) {
+					hist[b] += t->sites[s].histogram[b].load(std::memory_order_relaxed);
+				}
+			}
+			if (!calls) continue;
+
+			fprintf(out, "%-24s calls %-10llu cycles/call %-12.1f", names[s],
+			        (unsigned long long)calls, double(total[CYCLES]) / calls);
+			if (hardware.load()) {
+				fprintf(out, " IPC %-6.2f cache-miss/call %-10.1f branch-miss/call %-10.1f",
+				        total[CYCLES] ? double(total[INSTRUCTIONS]) / total[CYCLES] : 0.0,
+				        double(total[CACHE_MISSES]) / calls,
+				        double(total[BRANCH_MISSES]) / calls);
+			}
+			fprintf(out, "\n    cycles histogram:");
+			for (int b = 0; b < kBuckets; ++b) {
+				if (hist[b]) fprintf(out, " [2^%d]=%llu", b, (unsigned long long)hist[b]);
+			}
+			fprintf(out, "\n");
+		}
+		if (out != stderr) fclose(out);
+	}
+};
+
+/*
+Per-thread perf event group, cycles is the leader so one read()
+returns all four counters. Opened lazily on the first probe. The
+sibling fds stay open for the life of the thread: closing one takes
+its event out of the group.
+*/
+struct ThreadCounters {
+
+	int fds[NUM_COUNTERS];
+	bool grouped;
+	ThreadBlock *block;
+
+	ThreadCounters() : grouped(false), block(new ThreadBlock()) {
+		for (int c = 0; c < NUM_COUNTERS; ++c) fds[c] = -1;
+		// The block outlives the thread so the exit report can read it
+		Registry::get().addThread(block);
+		open();
+	}
+
+	~ThreadCounters() {
+		closeAll();
+	}
+
+	void closeAll() {
+		for (int c = NUM_COUNTERS - 1; c >= 0; --c) {
+			if (fds[c] >= 0) close(fds[c]);
+			fds[c] = -1;
+		}
+		grouped = false;
+	}
+
+	void open() {
+#ifdef __linux__
+		static const uint64_t configs[NUM_COUNTERS] = {
+			PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS,
+			PERF_COUNT_HW_CACHE_MISSES, PERF_COUNT_HW_BRANCH_MISSES
+		};
+		for (int c = 0; c < NUM_COUNTERS; ++c) {
+			perf_event_attr attr;
+			memset(&attr, 0, sizeof attr);
+			attr.size = sizeof attr;
+			attr.type = PERF_TYPE_HARDWARE;
+			attr.config = configs[c];
+			attr.read_format = PERF_FORMAT_GROUP;
+			attr.exclude_kernel = 1;
+			attr.exclude_hv = 1;
+			attr.disabled = c == 0;
+
+			fds[c] = syscall(SYS_perf_event_open, &attr, 0, -1, c ? fds[0] : -1, 0);
+			if (fds[c] < 0) {
+				closeAll();
+				return;
+			}
+		}
+		ioctl(fds[0], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+
+		// Only a group that reads back whole counts as hardware
+		uint64_t group[1 + NUM_COUNTERS];
+		if (::read(fds[0], group, sizeof group) != sizeof group || group[0] != NUM_COUNTERS) {
+			closeAll();
+			return;
+		}
+		grouped = true;
+		Registry::get().hardware.store(true);
+#endif
+	}
+
+	void read(uint64_t values[NUM_COUNTERS]) {
+		if (grouped) {
+			uint64_t group[1 + NUM_COUNTERS];
+			if (::read(fds[0], group, sizeof group) == sizeof group && group[0] == NUM_COUNTERS) {
+				memcpy(values, group + 1, sizeof(uint64_t) * NUM_COUNTERS);
+				return;
+			}
+		}
+		memset(values, 0, sizeof(uint64_t) * NUM_COUNTERS);
+		values[CYCLES] = timestamp();
+	}
+
+	static ThreadCounters &get() {
+		static thread_local ThreadCounters counters;
+		return counters;
+	}
+};
+
+struct Site {
+	int id;
+	explicit Site(const char *name) : id(Registry::get().addSite(name)) {}
+};
+
+class Scoped {
+
+public:
+	explicit Scoped(const Site &site) : id(site.id), counters(ThreadCounters::get()) {
+		counters.read(start);
+	}
+
+	~Scoped() {
+		if (id < 0) return;
+
+		uint64_t end[NUM_COUNTERS];
+		counters.read(end);
+
+		SiteStats &stats = counters.block->sites[id];
+		bump(stats.calls, 1);
+		for (int c = 0; c < NUM_COUNTERS; ++c) bump(stats.total[c], end[c] - start[c]);
+
+		uint64_t cycles = end[CYCLES] - start[CYCLES];
+		int bucket = cycles ? 63 - __builtin_clzll(cycles) : 0;
+		bump(stats.histogram[bucket < kBuckets ? bucket : kBuckets - 1], 1);
+	}
+
+private:
+	int id;
+	ThreadCounters &counters;
+	uint64_t start[NUM_COUNTERS];
+};
+
+} // namespace probe
+
+#ifdef EPI_PROBES
+#define EPI_PROBE_CAT2(a, b) a##b
+#define EPI_PROBE_CAT(a, b) EPI_PROBE_CAT2(a, b)
+#define EPI_PROBE(name) \
+	static probe::Site EPI_PROBE_CAT(epiProbeSite, __LINE__)(name); \
+	probe::Scoped EPI_PROBE_CAT(epiProbe, __LINE__)(EPI_PROBE_CAT(epiProbeSite, __LINE__))
+#else
+#define EPI_PROBE(name) do {} while (0)
+#endif
+
+// Probe a single call without editing the callee, one site per use
+#define EPI_PROBE_CALL(name, call) ([&]() { EPI_PROBE(name); return call; }())
+
+#endif
@@ -0,0 +1,323 @@
+#include "EPI.h"
+
+/*
+Checks for the column routines, BufferedWriter and the driver, the cases
+a quick look at the output would miss: values at the ends of the type,
+files that change length, every dispatch tier. Built like the benchmarks:
+
+	make test
+
+Driver cases run ./EPI, so they go from the repository directory.
+*/
+
+static int failures = 0;
+
+#define CHECK(cond) do { \
+	if (!(cond)) { \
+		fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond); \
+		++failures; \
+	} \
+} while (0)
+
+/******* 6.6 over columns *******/
+
+template<class T>
+static void stockExtremes() {
+	typedef typename std::make_unsigned<T>::type U;
+	const T lo = std::numeric_limits<T>::min(), hi = std::numeric_limits<T>::max();
+
+	T rising[] = {lo, hi};
+	CHECK(max_stock_diff_column(rising, 2) == std::numeric_limits<U>::max());
+
+	T falling[] = {hi, 0, lo};
+	CHECK(max_stock_diff_column(falling, 3) == 0);
+
+	T mixed[] = {0, lo, -1, hi, lo};
+	CHECK(max_stock_diff_column(mixed, 5) == std::numeric_limits<U>::max());
+
+	T nearTop[] = {-1, hi};
+	CHECK(max_stock_diff_column(nearTop, 2) == U(hi) + 1);
+
+	U best = 0;
+	Pipeline<T> p;
+	p.then(max_stock_diff_stage<T>(best));
+	p.run(rising, 2, false);
+	CHECK(best == std::numeric_limits<U>::max());
+}
+
+/******* Dispatched kernels, on every tier this CPU has *******/
+
+// 5.3's revBits only turns the low 32 bits around, go bit by bit
+static uint64_t reversedBits(uint64_t x) {
+	uint64_t r = 0;
+	for (int i = 0; i < 64; ++i) r |= (x >> i & 1) << (63 - i);
+	return r;
+}
+
+// reverse_digits_batch against reverse_digits one value at a time
+template<class T>
+static int reversalsDiffer(const std::vector<uint64_t> &words) {
+	const T lo = std::numeric_limits<T>::min(), hi = std::numeric_limits<T>::max();
+	std::vector<T> in;
+	T edges[] = {0, 1, -1, 9, 10, -10, lo, hi, T(lo + 1), T(hi - 1), T(hi / 10), T(lo / 10)};
+	in.insert(in.end(), edges, edges + sizeof edges / sizeof edges[0]);
+
+	// Largest that reverse into range and the first that do not
+	if (sizeof(T) == 4) {
+		int64_t fits[] = {1463847412, -1463847412, -1563847412, 1463847413, -1563847413, 1000000003, 2000000002};
+		in.insert(in.end(), fits, fits + 7);
+	} else {
+		int64_t fits[] = {
+			7085774586302733229LL, -8085774586302733229LL, 7085774586302733230LL, -8085774586302733230LL,
+			1000000000000000003LL, 9000000000000000009LL
+		};
+		in.insert(in.end(), fits, fits + 6);
+	}
+	// Every length, both signs
+	for (size_t i = 0; i < words.size(); ++i) {
+		T x = T(words[i] >> (i % (8 * sizeof(T))));
+		in.push_back(i & 1 ? T(0) - x : x);
+	}
+	// Odd count, so a pairwise kernel has a tail
+	if (in.size() % 2 == 0) in.pop_back();
+
+	size_t n = in.size();
+	std::vector<T> out(n, 7);
+	std::vector<unsigned char> ok(n, 7);
+	size_t good = reverse_digits_batch(in.data(), out.data(), ok.data(), n);
+
+	int bad = 0;
+	size_t expectGood = 0;
+	for (size_t i = 0; i < n; ++i) {
+		T expect = 0;
+		bool fits = reverse_digits(in[i], expect);
+		expectGood += fits;
+		bad += ok[i] != fits || out[i] != expect;
+	}
+	return bad + (good != expectGood);
+}
+
+static void kernelsMatchScalar() {
+	std::mt19937_64 gen(1);
+	std::vector<uint64_t> words(4096);
+	for (size_t i = 0; i < words.size(); ++i) {
+		// Random words, sparse ones, and palindromic ids of every length
+		uint64_t x = gen();
+		if (i % 4 == 1) x &= gen() & gen();
+		if (i % 4 == 2) x >>= gen() % 64;
+		if (i % 4 == 3) {
+			std::string s = std::to_string(gen() % 10000000000ULL);
+			s = s.substr(0, 1 + i % s.size());
+			s += std::string(s.rbegin() + (i & 8 ? 1 : 0), s.rend());
+			x = strtoull(s.c_str(), 0, 10);
+		}
+		words[i] = x;
+	}
+	words[0] = 0;
+	words[1] = ~uint64_t(0);
+
+	size_t n = words.size();
+	std::vector<unsigned char> bytes(n);
+	std::vector<uint64_t> wide(n);
+
+	for (int t = dispatch::SCALAR; t < dispatch::NUM_TIERS; ++t) {
+		dispatch::Tier tier = static_cast<dispatch::Tier>(t);
+		if (!dispatch::force(tier)) continue;
+		const char *name = dispatch::tierName(tier);
+		int bad = 0;
+
+		dispatch::active.parityBatch(words.data(), n, bytes.data());
+		for (size_t i = 0; i < n; ++i) bad += bytes[i] != parityDivAndConq(words[i]);
+
+		dispatch::active.popcountWords(words.data(), n, bytes.data());
+		for (size_t i = 0; i < n; ++i) bad += bytes[i] != __builtin_popcountll(words[i]);
+
+		dispatch::active.reverseBitsBatch(words.data(), n, wide.data());
+		for (size_t i = 0; i < n; ++i) bad += wide[i] != reversedBits(words[i]);
+
+		dispatch::active.palindromeBatch(words.data(), n, bytes.data());
+		for (size_t i = 0; i < n; ++i) bad += bytes[i] != checkPalindromeDigits(words[i]);
+
+		for (size_t i = 0; i < 256; ++i) {
+			uint64_t w = words[i];
+			unsigned r = 0;
+			for (unsigned b = 0; b < 64; ++b) {
+				if (w >> b & 1) bad += dispatch::active.selectInWord(w, r++) != b;
+			}
+		}
+
+		bad += reversalsDiffer<int32_t>(words);
+		bad += reversalsDiffer<int64_t>(words);
+
+		if (bad) fprintf(stderr, "tier %s: %d mismatches\n", name, bad);
+		CHECK(bad == 0);
+	}
+	dispatch::force(dispatch::detect());
+}
+
+/******* BufferedWriter *******/
+
+// What out writes for dump(values, mode), through a temp file
+template<class C>
+static std::string dumped(const C &values, BufferedWriter::Mode mode) {
+	FILE *f = tmpfile();
+	{
+		BufferedWriter out(fileno(f));
+		out.dump(values, mode);
+	}
+	std::string s;
+	rewind(f);
+	char buf[256];
+	while (size_t n = fread(buf, 1, sizeof(buf), f)) s.append(buf, n);
+	fclose(f);
+	return s;
+}
+
+static void writerModes() {
+	double special[] = {1.5, NAN, INFINITY, -INFINITY};
+	std::vector<double> d(special, special + 4);
+	CHECK(dumped(d, BufferedWriter::JSON) == "[1.5,null,null,null]");
+	CHECK(dumped(d, BufferedWriter::CSV) == "1.5,nan,inf,-inf\n");
+
+	// No raw object bytes for a std::string, its text instead
+	std::vector<std::string> s;
+	s.push_back("ab");
+	s.push_back("c\"d");
+	CHECK(dumped(s, BufferedWriter::BINARY) == "ab,c\"d");
+	CHECK(dumped(s, BufferedWriter::JSON) == "[\"ab\",\"c\\\"d\"]");
+
+	int32_t raw[] = {1, -2};
+	std::vector<int32_t> v(raw, raw + 2);
+	CHECK(dumped(v, BufferedWriter::BINARY) == std::string(reinterpret_cast<const char *>(raw), sizeof raw));
+}
+
+/******* Pool *******/
+
+static size_t poolSizeWith(const char *threads) {
+	setenv("EPI_THREADS", threads, 1);
+	Pool pool;
+	unsetenv("EPI_THREADS");
+	return pool.size();
+}
+
+static void poolThreadsFromEnv() {
+	size_t cores = std::max(1u, std::thread::hardware_concurrency());
+	CHECK(poolSizeWith("3") == 3);
+	CHECK(poolSizeWith("-1") == cores);
+	CHECK(poolSizeWith("0") == cores);
+	CHECK(poolSizeWith("four") == cores);
+	CHECK(poolSizeWith("2x") == cores);
+	CHECK(poolSizeWith("99999999999999999999") == cores);
+}
+
+/******* Driver *******/
+
+static std::string tempPath() {
+	char path[] = "/tmp/epi_testXXXXXX";
+	int fd = mkstemp(path);
+	if (fd >= 0) close(fd);
+	return path;
+}
+
+template<class T>
+static void writeColumn(const std::string &path, const std::vector<T> &v) {
+	FILE *f = fopen(path.c_str(), "wb");
+	if (!v.empty()) fwrite(v.data(), sizeof(T), v.size(), f);
+	fclose(f);
+}
+
+template<class T>
+static std::vector<T> readColumn(const std::string &path) {
+	std::vector<T> v;
+	FILE *f = fopen(path.c_str(), "rb");
+	T x;
+	while (fread(&x, sizeof(T), 1, f) == 1) v.push_back(x);
+	fclose(f);
+	return v;
+}
+
+// ./EPI with args, what it printed and whether it exited 0
+static bool runEPI(const std::string &args, std::string &output) {
+	FILE *p = popen(("./EPI " + args).c_str(), "r");
+	if (!p) return false;
+	output.clear();
+	char buf[4096];
+	while (size_t n = fread(buf, 1, sizeof(buf), p)) output.append(buf, n);
+	return pclose(p) == 0;
+}
+
+static void driverExtremes() {
+	std::string path = tempPath(), output;
+
+	int32_t i32[] = {std::numeric_limits<int32_t>::min(), std::numeric_limits<int32_t>::max()};
+	writeColumn(path, std::vector<int32_t>(i32, i32 + 2));
+	CHECK(runEPI("max_stock_diff " + path, output) && output == "4294967295\n");
+	CHECK(runEPI("max_stock_diff --direct " + path, output) && output == "4294967295\n");
+
+	int64_t i64[] = {std::numeric_limits<int64_t>::min(), std::numeric_limits<int64_t>::max()};
+	writeColumn(path, std::vector<int64_t>(i64, i64 + 2));
+	CHECK(runEPI("max_stock_diff --type=i64 " + path, output) && output == "18446744073709551615\n");
+
+	unlink(path.c_str());
+}
+
+// --in-place leaves the result in the file, cut to its length
+static void driverInPlace() {
+	std::string path = tempPath(), copy = tempPath(), output;
+
+	int32_t sorted[] = {1, 1, 2, 3, 3, 3, 7};
+	writeColumn(path, std::vector<int32_t>(sorted, sorted + 7));
+	CHECK(runEPI("del_dup_sorted --in-place " + path, output) && output.empty());
+	std::vector<int32_t> distinct = readColumn<int32_t>(path);
+	int32_t expect[] = {1, 2, 3, 7};
+	CHECK(distinct == std::vector<int32_t>(expect, expect + 4));
+
+	// Already distinct: nothing to cut
+	CHECK(runEPI("del_dup_sorted --in-place " + path, output));
+	CHECK(readColumn<int32_t>(path) == distinct);
+
+	// --out still gets a copy
+	writeColumn(path, std::vector<int32_t>(sorted, sorted + 7));
+	CHECK(runEPI("del_dup_sorted --in-place --out=" + copy + " " + path, output) && output.empty());
+	CHECK(readColumn<int32_t>(path) == distinct);
+	std::vector<char> text = readColumn<char>(copy);
+	CHECK(std::string(text.begin(), text.end()) == "[ 1 2 3 7 ]");
+
+	std::vector<int64_t> values;
+	for (int64_t i = 0; i < 1000; ++i) values.push_back(i * i);
+	writeColumn(path, values);
+	CHECK(runEPI("random_subset --type=i64 --in-place --k=10 --seed=1 " + path, output) && output.empty());
+	std::vector<int64_t> sample = readColumn<int64_t>(path);
+	CHECK(sample.size() == 10);
+	std::sort(sample.begin(), sample.end());
+	CHECK(std::unique(sample.begin(), sample.end()) == sample.end());
+	for (size_t i = 0; i < sample.size(); ++i) {
+		CHECK(std::binary_search(values.begin(), values.end(), sample[i]));
+	}
+
+	// k past the end keeps the whole column, shuffled
+	writeColumn(path, values);
+	CHECK(runEPI("random_subset --type=i64 --in-place --k=5000 --seed=1 " + path, output));
+	CHECK(readColumn<int64_t>(path).size() == values.size());
+
+	unlink(path.c_str());
+	unlink(copy.c_str());
+}
+
+int main() {
+
+	stockExtremes<int32_t>();
+	stockExtremes<int64_t>();
+	kernelsMatchScalar();
+	writerModes();
+	poolThreadsFromEnv();
+	driverExtremes();
+	driverInPlace();
+
+	if (failures) {
+		fprintf(stderr, "%d checks failed\n", failures);
+		return 1;
+	}
+	puts("all checks passed");
+	return 0;
+}